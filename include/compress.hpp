@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+namespace btd {
+
+enum class coding : std::uint8_t
+{
+    identity,
+    gzip,
+    deflate // zlib stream, as HTTP means it
+};
+
+// compress in into out with zlib, false on failure
+bool
+compress(std::string_view in, std::string& out, coding c, int level);
+
+char const*
+coding_name(coding c) noexcept;
+
+// the best coding the client accepts among the ones we produce
+coding
+accepted_coding(std::string_view accept_encoding) noexcept;
+
+// whether a mime type is worth compressing
+bool
+compressible(std::string_view mime) noexcept;
+
+// CPU time of the calling thread in microseconds
+std::uint64_t
+thread_cpu_us() noexcept;
+
+// Totals of the response compression
+struct compress_stats
+{
+    std::atomic_int64_t responses{0}; // compressed
+    std::atomic_int64_t skipped{0};   // eligible but not worth it
+    std::atomic_int64_t bytes_in{0};
+    std::atomic_int64_t bytes_out{0};
+    std::atomic_int64_t cpu_us{0};
+
+    void
+    record(std::size_t in, std::size_t out, std::uint64_t us) noexcept;
+
+    json::value
+    to_json() const;
+};
+
+} // namespace btd
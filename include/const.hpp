@@ -22,6 +22,24 @@
 #define ENV_MOVED_ROOT "KEDGE_MOVED_ROOT"
 #define ENV_HTTP_ADDR "KEDGE_HTTP_ADDR"
 #define ENV_HTTP_PORT "KEDGE_HTTP_PORT"
+#define ENV_HTTP_UNIX "KEDGE_HTTP_UNIX"
+#define ENV_HTTP_UNIX_MODE "KEDGE_HTTP_UNIX_MODE"
+#define ENV_SAVE_DEADLINE "KEDGE_SAVE_DEADLINE"
+#define ENV_WATCH_DIRS "KEDGE_WATCH_DIRS"
+#define ENV_COMPRESS_LEVEL "KEDGE_COMPRESS_LEVEL"
+#define ENV_HTTP_THREADS "KEDGE_HTTP_THREADS"
+#define ENV_QUERY_THREADS "KEDGE_QUERY_THREADS"
+#define ENV_HTTP_REUSEPORT "KEDGE_HTTP_REUSEPORT"
+#define ENV_DISK_THREADS "KEDGE_DISK_THREADS"
+#define ENV_CPU_HTTP "KEDGE_CPU_HTTP"
+#define ENV_CPU_ALERT "KEDGE_CPU_ALERT"
+#define ENV_CPU_TORRENT "KEDGE_CPU_TORRENT"
+#define ENV_CPU_BLOCKING "KEDGE_CPU_BLOCKING"
+#define ENV_DHT "KEDGE_DHT"
+#define ENV_DHT_UPLOAD_RATE "KEDGE_DHT_UPLOAD_RATE"
+#define ENV_DHT_MAX_PEERS "KEDGE_DHT_MAX_PEERS"
+#define ENV_DHT_PRIVACY "KEDGE_DHT_PRIVACY"
+#define ENV_TRACKER_SUPPRESS "KEDGE_TRACKER_SUPPRESS"
 
 
 #endif // INCLUDE_CONFIG_H
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/http/empty_body.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/serializer.hpp>
+
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "net.hpp"
+#include "sheath.hpp"
+
+namespace btd {
+
+class content_stream;
+
+// Active content streams and their totals
+class stream_registry
+{
+    mutable std::mutex mutex_;
+    std::unordered_map<std::uint64_t, std::weak_ptr<content_stream>> active_;
+    std::uint64_t last_id_ = 0;
+
+public:
+    std::atomic_int64_t streams{0};
+    std::atomic_int64_t bytes{0};
+    std::atomic_int64_t stalls{0};
+    std::atomic_int64_t stall_ms{0};
+    std::atomic_int64_t aborted{0};
+
+    std::uint64_t
+    add(std::weak_ptr<content_stream> cs);
+    void
+    remove(std::uint64_t id);
+
+    json::value
+    to_json() const;
+};
+
+/** Sends a byte range of a torrent file as it becomes available
+
+    Pieces covering the window get a deadline, bytes of pieces we
+    already have go out with sendfile straight from the page cache.
+    A piece passes its hash check while still in the write cache, so
+    one finished after the stream opened is sent only after a flush of
+    it is confirmed, see stream_pieces.
+*/
+class content_stream : public std::enable_shared_from_this<content_stream>
+{
+public:
+    // called once the response is complete or failed
+    using done_handler = std::function<void(beast::error_code, bool close)>;
+
+    content_stream(
+        http_stream& stream,
+        content_plan plan,
+        std::int64_t first,
+        std::int64_t last,
+        http::response<http::empty_body> header,
+        stream_registry& registry);
+
+    ~content_stream();
+
+    void
+    run(bool head_only, done_handler done);
+
+    json::object
+    to_json() const;
+
+private:
+    http_stream& stream_;
+    content_plan const plan_;
+    lt::sha1_hash const ih_;    // the handle has none once removed
+    std::int64_t const first_;
+    std::int64_t const last_;   // inclusive
+    std::int64_t pos_;          // next byte of the file to send
+    std::int64_t have_end_;     // end of the contiguous pieces on disk
+    int deadline_upto_ = -1;    // last piece given a deadline
+    int fd_ = -1;
+
+    http::response<http::empty_body> res_;
+    std::optional<http::response_serializer<http::empty_body>> sr_;
+    net::steady_timer timer_;
+    done_handler done_;
+    stream_registry& registry_;
+    std::uint64_t id_ = 0;
+
+    std::chrono::steady_clock::time_point started_;
+    std::chrono::steady_clock::time_point stall_start_;
+    bool stalled_ = false;
+    stream_pieces::wait waiting_ = stream_pieces::wait::none;
+    bool flushing_ = false;
+    std::chrono::steady_clock::time_point flush_start_;
+    std::atomic_int64_t sent_{0};
+    std::atomic_int64_t stalls_{0};
+    std::atomic_int64_t stall_ms_{0};
+
+#ifndef __linux__
+    std::array<char, 64 * 1024> buf_;
+#endif
+
+    std::int64_t
+    available();
+    void
+    set_deadlines();
+    bool
+    open_file();
+    void
+    send_some();
+    void
+    on_sent(std::size_t n);
+    void
+    wait_pieces();
+    void
+    wait_flush();
+    void
+    finish(beast::error_code ec);
+};
+
+} // namespace btd
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+
+#include <boost/asio/io_context.hpp>
+#ifdef __linux__
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <sys/inotify.h>
+#endif
+
+#include "net.hpp"
+#include "sheath.hpp"
+
+namespace btd {
+
+/** Feeds the watch directories of a sheath from inotify events
+
+    Runs on the asio loop, a file is handed over once it has been
+    closed after writing or moved into the directory. Without
+    inotify run() returns false and the polling scan stays in charge.
+*/
+class dir_watcher : public std::enable_shared_from_this<dir_watcher>
+{
+    std::shared_ptr<sheath> shth_;
+#ifdef __linux__
+    net::posix::stream_descriptor desc_;
+    // watch descriptor to the directory it watches
+    std::unordered_map<int, sheath::watch_dir> wds_;
+    alignas(inotify_event) std::array<char, 8192> buf_;
+#endif
+
+    void do_read();
+    void on_read(beast::error_code ec, std::size_t bytes);
+
+public:
+    dir_watcher(
+        net::io_context& ioc,
+        std::shared_ptr<sheath> const& shth);
+
+    // Start watching, false when events are unavailable
+    bool run();
+};
+
+} // namespace btd
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/torrent_info.hpp>
+
+namespace btd {
+
+/** The files of a torrent as listed by /files, built once
+
+    Names, paths and sizes never change, so their JSON is rendered
+    when the table is built along with the directory tree. Only which
+    files are complete changes, from file_completed_alert; a recheck
+    drops the table, as files may be complete no more. A failed piece
+    does not, no complete file holds it.
+*/
+class file_table
+{
+public:
+    struct dir
+    {
+        std::vector<std::string> dirs; // names of the subdirectories
+        std::vector<int> files;        // indices of the files right in it
+        std::int64_t size = 0;         // of everything below
+        int count = 0;
+    };
+
+    // progress of each file, as from torrent_handle::file_progress
+    file_table(std::shared_ptr<lt::torrent_info const> ti, std::vector<std::int64_t> const& progress);
+
+    int
+    size() const noexcept
+    {
+        return int(sizes_.size());
+    }
+
+    // "name":...,"path":...,"size":...
+    std::string const&
+    entry(int i) const
+    {
+        return entries_[std::size_t(i)];
+    }
+
+    std::int64_t
+    file_size(int i) const
+    {
+        return sizes_[std::size_t(i)];
+    }
+
+    bool
+    complete(int i) const
+    {
+        return complete_[std::size_t(i)].load(std::memory_order_relaxed);
+    }
+
+    void
+    set_complete(int i)
+    {
+        if (i >= 0 && i < size()) complete_[std::size_t(i)].store(true, std::memory_order_relaxed);
+    }
+
+    // "" for the root, null when there is no such directory
+    dir const*
+    find_dir(std::string_view path) const;
+
+private:
+    std::shared_ptr<lt::torrent_info const> ti_;
+    std::vector<std::string> entries_;
+    std::vector<std::int64_t> sizes_;
+    std::unique_ptr<std::atomic_bool[]> complete_;
+    std::unordered_map<std::string, dir> dirs_;
+};
+
+// file_tables of the torrents listed last, at most FILES_CACHE_MAX
+class file_cache
+{
+    std::mutex mutex_;
+    // with the tick of their last use
+    std::unordered_map<lt::sha1_hash, std::pair<std::shared_ptr<file_table>, std::uint64_t>> tables_;
+    std::uint64_t tick_ = 0;
+
+public:
+    std::shared_ptr<file_table>
+    find(lt::sha1_hash const& ih);
+
+    void
+    store(lt::sha1_hash const& ih, std::shared_ptr<file_table> table);
+
+    void
+    file_completed(lt::sha1_hash const& ih, int index);
+
+    void
+    remove(lt::sha1_hash const& ih);
+};
+
+} // namespace btd
@@ -1,9 +1,15 @@
 #pragma once
 
-#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/asio/associated_cancellation_slot.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/beast/http/message.hpp>
 #include <boost/beast/http/string_body.hpp>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -13,9 +19,16 @@
 #include <boost/json/value.hpp>
 namespace json = boost::json;
 
+#include "compress.hpp"
+#include "content_stream.hpp"
 #include "http_util.hpp"
+#include "metrics.hpp"
 #include "net.hpp"
+#include "router.hpp"
 #include "sheath.hpp"
+#include "static_cache.hpp"
+#include "thread_util.hpp"
+#include "upload_pool.hpp"
 #include "util.hpp"
 
 namespace btd {
@@ -43,6 +56,60 @@ class httpCaller : public std::enable_shared_from_this<httpCaller>
     json::value prev_stats = json::value(nullptr);
     json::value curr_stats = json::value(nullptr);
 
+    // torrent payload being streamed to clients
+    stream_registry streams_;
+
+    using route_fn = std::function<http::response<string_body>(
+        http::request<string_body> const&, route_params const&)>;
+
+    struct route
+    {
+        route_fn fn;
+        std::size_t body_limit = REQUEST_BODY_MAX;
+        bool offload = true; // blocks on the session, runs on queries_
+    };
+
+    // API routes under /api, built once by make_routes
+    router<route> routes_;
+
+    void
+    make_routes();
+
+    route const*
+    find_route(http::verb method, std::string_view target) const noexcept;
+
+    // web ui files in memory
+    static_cache assets_;
+
+    // large API responses are compressed off the I/O threads
+    int compress_level_ = COMPRESS_LEVEL;
+    compress_stats zip_stats_;
+    pool_stats zip_pool_{COMPRESS_WORKERS};
+    boost::asio::thread_pool zippers_{COMPRESS_WORKERS};
+
+    // buffers and counters of large request bodies
+    upload_pool uploads_;
+
+    struct query_stats
+    {
+        std::atomic_int64_t queries{0};
+        std::atomic_int64_t inflight{0}; // queued or running on queries_
+        std::atomic_int64_t rejected{0}; // over QUERY_QUEUE_MAX
+        std::atomic_int64_t timeouts{0};
+        std::atomic_int64_t abandoned{0}; // cancelled before they started
+    };
+    query_stats query_stats_;
+    pool_stats query_pool_;
+
+    // handlers blocking on libtorrent run here, off the I/O threads
+    boost::asio::thread_pool queries_;
+
+    // lag of the http io_context, filled by a loop_probe
+    loop_stats http_loop_;
+
+    // cpus each group of threads is pinned to
+    json::object affinity_;
+
 public:
 
 	// return string_body response
@@ -55,6 +122,10 @@ public:
     http::response<string_body>
     handleSessionStats(http::request<string_body> const& req);
 
+    // ?metric=rateRecv,rateSent&range=24h, all metrics of the last 10m by default
+    http::response<string_body>
+    handleSessionHistory(http::request<string_body> const& req);
+
     http::response<string_body>
     handleSessionToggle(http::request<string_body> const& req);
 
@@ -62,11 +133,165 @@ public:
     handleTorrents(http::request<string_body> const& req) ;
 
     http::response<string_body>
-    handleTorrent(http::request<string_body> const& req, size_t const offset);
+    handleTorrent(http::request<string_body> const& req, std::string_view const hash
+        , std::string_view const act);
+
+    http::response<string_body>
+    handleTorrentHistory(http::request<string_body> const& req, std::string_view const hash);
+
+    http::response<string_body>
+    handleTorrentFiles(http::request<string_body> const& req, std::string_view const hash);
+
+    http::response<string_body>
+    handleTorrentPieces(http::request<string_body> const& req, std::string_view const hash);
+
+    http::response<string_body>
+    handleBatch(http::request<string_body> const& req);
+
+    http::response<string_body>
+    handleBulk(http::request<string_body> const& req, std::string_view const id);
 
     http::response<string_body>
     handleSyncStats(http::request<string_body> const& req);
 
+    http::response<string_body>
+    handleDht(http::request<string_body> const& req);
+
+    http::response<string_body>
+    handlePeers(http::request<string_body> const& req);
+
+    http::response<string_body>
+    handleTrackers(http::request<string_body> const& req);
+
+    http::response<string_body>
+    handleStreams(http::request<string_body> const& req);
+
+    http::response<string_body>
+    handleServerStats(http::request<string_body> const& req);
+
+    // GET /metrics, libtorrent and our own counters for prometheus
+    http::response<string_body>
+    handleMetrics(http::request<string_body> const& req);
+
+    // whether res is worth compressing with c, marks it Vary if so
+    bool
+    compressing(http::response<string_body>& res, coding c);
+
+    // compress on a worker then hand the response to done, from that worker
+    void
+    compress_async(http::response<string_body>&& res, coding c,
+        std::function<void(http::response<string_body>&&)> done);
+
+    // largest body the route of target takes
+    std::size_t
+    body_limit(http::verb method, std::string_view target) const noexcept;
+
+    // whether the route of target blocks on the session
+    bool
+    offloaded(http::verb method, std::string_view target) const noexcept;
+
+    // take a slot for async_call, false when the pool is backed up
+    bool
+    admit_query() noexcept;
+
+    void
+    count_timeout() noexcept
+    {
+        ++query_stats_.timeouts;
+    }
+
+    /** sbCall on the query pool, after admit_query
+
+        Completes on the executor of the token's handler. On cancellation
+        it completes at once with operation_aborted: work still queued is
+        skipped and a running call has its result dropped.
+    */
+    template<class CompletionToken>
+    auto
+    async_call(std::shared_ptr<http::request<string_body> const> req, CompletionToken&& token)
+    {
+        using result_type = std::optional<http::response<string_body>>;
+        return boost::asio::async_initiate<CompletionToken, void(beast::error_code, result_type)>(
+            [this](auto handler, std::shared_ptr<http::request<string_body> const> req)
+            {
+                using handler_type = decltype(handler);
+                struct state
+                {
+                    std::atomic_bool done{false};
+                    handler_type handler;
+                    explicit state(handler_type&& h) : handler(std::move(h)) {}
+                };
+                auto st = std::make_shared<state>(std::move(handler));
+
+                auto const complete = [](std::shared_ptr<state> st, beast::error_code ec, result_type res)
+                {
+                    auto const ex = boost::asio::get_associated_executor(st->handler);
+                    boost::asio::post(ex, [st, ec, res = std::move(res)]() mutable
+                    {
+                        boost::asio::get_associated_cancellation_slot(st->handler).clear();
+                        std::move(st->handler)(ec, std::move(res));
+                    });
+                };
+
+                auto slot = boost::asio::get_associated_cancellation_slot(st->handler);
+                if (slot.is_connected())
+                {
+                    slot.assign([st, complete](boost::asio::cancellation_type)
+                    {
+                        if (!st->done.exchange(true))
+                            complete(st, boost::asio::error::operation_aborted, std::nullopt);
+                    });
+                }
+
+                tracked_post(queries_, query_pool_, [this, st, complete, req = std::move(req)]
+                {
+                    if (st->done.load())
+                    {
+                        ++query_stats_.abandoned;
+                    }
+                    else
+                    {
+                        auto res = sbCall(*req);
+                        if (!st->done.exchange(true)) complete(st, {}, std::move(res));
+                    }
+                    --query_stats_.inflight;
+                });
+            }, token, std::move(req));
+    }
+
+    upload_pool&
+    uploads() noexcept
+    {
+        return uploads_;
+    }
+
+    loop_stats&
+    http_loop() noexcept
+    {
+        return http_loop_;
+    }
+
+    void
+    set_affinity(json::object affinity)
+    {
+        affinity_ = std::move(affinity);
+    }
+
+    void
+    set_compress_level(int level) noexcept
+    {
+        compress_level_ = level;
+    }
+
+    // /api/torrent/{info_hash}/content/{file_index}
+    static bool
+    is_content(std::string_view target) noexcept;
+
+    // a stream ready to run on the connection, or the response to send instead
+    std::optional<http::response<string_body>>
+    openContent(http::request<string_body> const& req, http_stream& stream,
+        std::shared_ptr<content_stream>& out);
+
     json::value
     getSyncStats();
 
@@ -92,7 +317,14 @@ public:
         return ui_root_;
     }
 
-	httpCaller(std::shared_ptr<sheath> const& shth, std::string ui_dir);
+    static_cache&
+    assets() noexcept
+    {
+        return assets_;
+    }
+
+	httpCaller(std::shared_ptr<sheath> const& shth, std::string ui_dir,
+		int query_threads = QUERY_WORKERS);
 
 	// ~httpCaller();
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace btd {
+
+/*  Text forms of digests, without streams and without allocating
+
+    Works on any digest length: 20 bytes for v1 info-hashes, 32 for
+    v2 SHA-256 ones. Decoders validate the whole input and leave out
+    untouched on failure.
+*/
+
+constexpr std::size_t
+hex_size(std::size_t bytes) noexcept
+{
+    return bytes * 2;
+}
+
+// RFC 4648 without padding, 32 chars for a sha1
+constexpr std::size_t
+base32_size(std::size_t bytes) noexcept
+{
+    return (bytes * 8 + 4) / 5;
+}
+
+// lowercase, writes hex_size(in.size()) chars
+void
+encode_hex(std::span<char const> in, char* out) noexcept;
+
+// either case, in must be exactly hex_size(out.size()) long
+bool
+decode_hex(std::string_view in, std::span<char> out) noexcept;
+
+// uppercase as in magnet links, writes base32_size(in.size()) chars
+void
+encode_base32(std::span<char const> in, char* out) noexcept;
+
+// either case, in must be exactly base32_size(out.size()) long
+bool
+decode_base32(std::string_view in, std::span<char> out) noexcept;
+
+bool
+is_hex(std::string_view in) noexcept;
+
+} // namespace btd
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/span.hpp>
+#include <libtorrent/torrent_status.hpp>
+
+#include "util.hpp"
+
+namespace btd {
+
+/** Session counters and rates over time, in fixed memory
+
+    Each session_stats_alert is folded into the open bucket of every
+    tier, a bucket closes into its ring as the mean of its samples once
+    the wall clock moves past it. Buckets with no sample read as null.
+*/
+class session_history
+{
+public:
+    struct tier_spec
+    {
+        int step;  // seconds per bucket
+        int slots; // buckets kept
+    };
+    // 1s for 10 minutes, 1m for 24 hours, 15m for 30 days
+    static constexpr tier_spec tiers[] = {{1, 600}, {60, 1440}, {900, 2880}};
+
+    session_history();
+
+    // counters of a session_stats_alert taken at t, microseconds
+    void
+    update(lt::span<std::int64_t const> counters, std::int64_t t);
+
+    // names of the metrics kept
+    static std::vector<std::string_view>
+    names();
+
+    // index of a metric in names(), -1 when unknown
+    static int
+    find(std::string_view name) noexcept;
+
+    /* {"step":60,"start":unix,"series":{"rateRecv":[...]}} for the last
+       range seconds, from the finest tier spanning it */
+    json::value
+    to_json(std::vector<int> const& metrics, std::int64_t range) const;
+
+private:
+    struct tier
+    {
+        int step;
+        int slots;
+        std::vector<float> values;   // slots * metrics, slot major
+        std::int64_t last = -1;      // bucket of the newest closed slot
+        std::int64_t open = -1;      // bucket being filled
+        std::vector<double> sum;     // of the open bucket, per metric
+        std::vector<int> count;
+
+        void
+        close(std::size_t metrics);
+        float
+        value(std::int64_t bucket, std::size_t metric, std::size_t metrics) const;
+    };
+
+    std::vector<int> index_; // counter of each metric
+    std::vector<std::int64_t> prev_;
+    std::int64_t prev_t_ = -1;
+
+    mutable std::mutex mutex_;
+    std::vector<tier> tiers_;
+};
+
+/** Recent rates, peers and progress of each torrent, quantized
+
+    One 8 byte sample per TORRENT_HISTORY_STEP seconds in a ring of
+    TORRENT_HISTORY_SLOTS, the last status of a bucket wins. As
+    state_update_alert only lists torrents that changed, a bucket
+    without one repeats the sample before it. Torrents past
+    TORRENT_HISTORY_MAX are not tracked, which bounds the memory.
+*/
+class torrent_history
+{
+public:
+    struct sample
+    {
+        std::uint16_t down; // payload bytes/s, as pack_rate
+        std::uint16_t up;
+        std::uint16_t peers;
+        std::uint16_t progress; // progress_ppm / 100
+    };
+
+    // 11 bits of mantissa and 5 of exponent, exact below 2048
+    static std::uint16_t
+    pack_rate(std::int64_t v) noexcept;
+    static std::int64_t
+    unpack_rate(std::uint16_t v) noexcept;
+
+    // from the alert thread
+    void
+    update(std::vector<lt::torrent_status> const& st);
+    void
+    remove(lt::sha1_hash const& ih);
+
+    /* {"step":60,"start":unix,"down":[...],"up":[...],"peers":[...],
+       "progress":[ppm...]} of the last points samples, null when the
+       torrent is not tracked */
+    json::value
+    to_json(lt::sha1_hash const& ih, int points = TORRENT_HISTORY_SLOTS) const;
+
+    std::size_t
+    size() const;
+
+    std::atomic_int64_t dropped{0}; // torrents over TORRENT_HISTORY_MAX
+
+private:
+    struct track
+    {
+        std::int64_t first = -1; // bucket of the oldest sample
+        std::int64_t last = -1;  // bucket of the newest sample
+        std::array<sample, TORRENT_HISTORY_SLOTS> ring;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<lt::sha1_hash, track> tracks_;
+};
+
+} // namespace btd
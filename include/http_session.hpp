@@ -1,13 +1,16 @@
 #pragma once
 
 
+#include <boost/asio/awaitable.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/empty_body.hpp>
 #include <boost/beast/http/parser.hpp>
 #include <boost/beast/http/file_body.hpp>
 #include <boost/beast/http/string_body.hpp>
-#include <boost/beast/core/tcp_stream.hpp>
 
+#include "compress.hpp"
 #include "net.hpp"
+#include "upload_body.hpp"
 
 #include <optional>
 #include <cstdlib>
@@ -21,22 +24,45 @@ class httpCaller;
 */
 class http_session : public std::enable_shared_from_this<http_session>
 {
-    beast::tcp_stream stream_;
+    http_stream stream_;
     beast::flat_buffer buffer_;
     std::shared_ptr<httpCaller> caller_;
 
     // The parser is stored in an optional container so we can
     // construct it from scratch it at the beginning of each new message.
-    std::optional<http::request_parser<http::string_body>> parser_;
+    std::optional<http::request_parser<upload_body>> parser_;
+
+    // The header is read first, the body limit depends on the route
+    std::optional<http::request_parser<http::empty_body>> header_parser_;
+
+    // whether the body buffer came from the caller's upload pool
+    bool pooled_ = false;
+
+    // what the current request accepts in Content-Encoding
+    coding accept_ = coding::identity;
 
     void fail(beast::error_code ec, char const* what);
     void do_read();
+    void on_read_header(beast::error_code ec, std::size_t);
     void on_read(beast::error_code ec, std::size_t);
     void on_write(beast::error_code ec, std::size_t, bool close);
 
+    // the parsed request, as the handlers take it
+    http::request<http::string_body> take_request();
+
+    // answer an API request from the caller's query pool
+    static net::awaitable<void>
+    call_api(std::shared_ptr<http_session> self,
+        std::shared_ptr<http::request<http::string_body>> req, bool pooled);
+
+    template<class Response>
+    void send(Response&& response);
+    template<class Message>
+    void write(std::shared_ptr<Message> sp);
+
 public:
     http_session(
-        tcp::socket&& socket,
+        stream_protocol::socket&& socket,
         std::shared_ptr<httpCaller> const& caller);
 
     void run();
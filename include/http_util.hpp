@@ -4,6 +4,9 @@
 #include <boost/beast/http/message.hpp>
 #include <boost/beast/http/string_body.hpp>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
 #include <string_view>
 
 #include "const.hpp"
@@ -16,6 +19,7 @@ using namespace std::literals::string_view_literals;
 
 auto const ctJSON = "application/json"sv;
 auto const ctText = "text/plain"sv;
+auto const ctMetrics = "text/plain; version=0.0.4"sv;
 auto const ctTorrent = "application/x-bittorrent"sv;
 
 auto const hdCacheControl = "no-cache, no-store, must-revalidate"sv;
@@ -96,9 +100,115 @@ mime_type(std::string_view path)
     if(iequals(ext, ".ico"))  return "image/vnd.microsoft.icon";
     if(iequals(ext, ".svg"))  return "image/svg+xml";
     if(iequals(ext, ".svgz")) return "image/svg+xml";
+    if(iequals(ext, ".mp4"))  return "video/mp4";
+    if(iequals(ext, ".m4v"))  return "video/mp4";
+    if(iequals(ext, ".mkv"))  return "video/x-matroska";
+    if(iequals(ext, ".webm")) return "video/webm";
+    if(iequals(ext, ".avi"))  return "video/x-msvideo";
+    if(iequals(ext, ".mp3"))  return "audio/mpeg";
+    if(iequals(ext, ".m4a"))  return "audio/mp4";
+    if(iequals(ext, ".flac")) return "audio/flac";
+    if(iequals(ext, ".ogg"))  return "audio/ogg";
     return "application/text";
 }
 
+// Raw value of key in the query string of target, empty when absent
+inline std::string_view
+query_arg(std::string_view target, std::string_view key)
+{
+    auto const q = target.find('?');
+    if (q == std::string_view::npos) return {};
+    target.remove_prefix(q + 1);
+    while (!target.empty())
+    {
+        auto const amp = target.find('&');
+        auto const pair = target.substr(0, amp);
+        auto const eq = pair.find('=');
+        if (pair.substr(0, eq) == key)
+            return eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1);
+        if (amp == std::string_view::npos) break;
+        target.remove_prefix(amp + 1);
+    }
+    return {};
+}
+
+// "90", "90s", "10m", "24h" or "30d" in seconds, false when malformed
+inline bool
+parse_duration(std::string_view v, std::int64_t& seconds)
+{
+    std::int64_t unit = 1;
+    if (!v.empty())
+    {
+        switch (v.back()) {
+        case 's': unit = 1; v.remove_suffix(1); break;
+        case 'm': unit = 60; v.remove_suffix(1); break;
+        case 'h': unit = 3600; v.remove_suffix(1); break;
+        case 'd': unit = 86400; v.remove_suffix(1); break;
+        }
+    }
+    std::int64_t n = 0;
+    auto const [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), n);
+    if (v.empty() || ec != std::errc() || ptr != v.data() + v.size() || n <= 0) return false;
+    seconds = n * unit;
+    return true;
+}
+
+// The first range of a "bytes=" Range header, false when unsatisfiable
+inline bool
+parse_range(std::string_view v, std::int64_t const size, std::int64_t& first, std::int64_t& last)
+{
+    auto const num = [](std::string_view s, std::int64_t& n)
+    {
+        while (!s.empty() && s.front() == ' ') s.remove_prefix(1);
+        while (!s.empty() && s.back() == ' ') s.remove_suffix(1);
+        auto const [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+        return !s.empty() && ec == std::errc() && ptr == s.data() + s.size();
+    };
+
+    if (!v.starts_with("bytes=")) return false;
+    v.remove_prefix(6);
+    v = v.substr(0, v.find(','));
+    auto const dash = v.find('-');
+    if (dash == std::string_view::npos) return false;
+    auto const a = v.substr(0, dash);
+    auto const b = v.substr(dash + 1);
+
+    if (a.find_first_not_of(' ') == std::string_view::npos)
+    {
+        // suffix range, the last n bytes
+        std::int64_t n = 0;
+        if (!num(b, n) || n <= 0) return false;
+        first = std::max<std::int64_t>(0, size - n);
+        last = size - 1;
+    }
+    else
+    {
+        if (!num(a, first)) return false;
+        if (b.find_first_not_of(' ') == std::string_view::npos) last = size - 1;
+        else if (!num(b, last)) return false;
+        last = std::min(last, size - 1);
+    }
+    return first >= 0 && first <= last && first < size;
+}
+
+// The {info_hash} and {file_index} of /api/torrent/{info_hash}/content/{file_index}
+inline bool
+content_target(std::string_view target, std::string_view& hash, std::string_view& index)
+{
+    auto const prefix = "/api/torrent/"sv;
+    auto const content = "/content/"sv;
+    target = target.substr(0, target.find('?'));
+    if (!target.starts_with(prefix)) return false;
+    target.remove_prefix(prefix.size());
+    auto const slash = target.find('/');
+    if (slash == std::string_view::npos) return false;
+    hash = target.substr(0, slash);
+    target.remove_prefix(slash);
+    if (!target.starts_with(content) || target.size() == content.size()) return false;
+    index = target.substr(content.size());
+    return true;
+}
+
 inline std::string
 url_decode(const std::string& value)
 {
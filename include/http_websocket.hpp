@@ -2,7 +2,6 @@
 
 #include <boost/beast/core/bind_handler.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
-#include <boost/beast/core/tcp_stream.hpp>
 #include <boost/beast/websocket/stream.hpp>
 
 #include <cstdlib>
@@ -29,7 +28,7 @@ class httpCaller;
 class websocket_session : public std::enable_shared_from_this<websocket_session>
 {
     beast::flat_buffer buffer_;
-    websocket::stream<beast::tcp_stream> ws_;
+    websocket::stream<http_stream> ws_;
     std::shared_ptr<httpCaller> caller_;
     std::vector<std::shared_ptr<std::string const>> queue_;
     std::string uri_;
@@ -43,7 +42,7 @@ class websocket_session : public std::enable_shared_from_this<websocket_session>
     void on_write(beast::error_code ec, std::size_t bytes_transferred);
 
 public:
-    websocket_session(tcp::socket&& socket, std::shared_ptr<httpCaller> const& state);
+    websocket_session(stream_protocol::socket&& socket, std::shared_ptr<httpCaller> const& state);
 
     ~websocket_session();
 
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+namespace btd {
+
+// one .torrent or magnet taken out of a bulk ingest body
+struct ingest_source
+{
+    std::string_view data; // slice of the job body
+    std::string owned;     // decoded payload, when not a plain slice
+    std::string name;
+    std::string save_path;
+    std::string error;     // rejected while splitting
+    bool magnet = false;
+
+    std::string_view
+    bytes() const noexcept
+    {
+        return owned.empty() ? data : std::string_view(owned);
+    }
+};
+
+enum class ingest_state : std::uint8_t
+{
+    queued,
+    submitted,
+    added,
+    failed
+};
+
+struct ingest_item
+{
+    std::string name;
+    std::string info_hash;
+    std::string error;
+    ingest_state state = ingest_state::queued;
+};
+
+// A bulk add request, split on a worker and tracked per item
+class ingest_job
+{
+    mutable std::mutex mutex_;
+    std::vector<ingest_source> sources_; // immutable once split
+    std::vector<ingest_item> items_;
+    int submitted_ = 0;
+    int added_ = 0;
+    int failed_ = 0;
+    std::atomic_bool split_{false};
+
+public:
+    std::uint64_t const id;
+    std::time_t const created;
+    std::string const body;
+    std::string const content_type;
+    std::string const save_path;
+
+    ingest_job(std::uint64_t id, std::string body, std::string content_type,
+        std::string save_path);
+
+    // split the body into sources, multipart or NDJSON
+    std::size_t
+    split();
+
+    ingest_source const&
+    source(std::size_t idx) const noexcept
+    {
+        return sources_[idx];
+    }
+
+    void
+    submit(std::size_t idx, std::string info_hash);
+    void
+    done(std::size_t idx, std::string const& error = "");
+
+    bool
+    finished() const;
+
+    json::value
+    to_json() const;
+};
+
+std::string_view
+multipart_boundary(std::string_view content_type);
+
+// split a multipart/form-data body, every part is one source
+bool
+split_multipart(std::string_view body, std::string_view boundary,
+    std::vector<ingest_source>& out);
+
+// one magnet or {"magnet"|"torrent"(base64), "name", "save_path"} per line
+void
+split_ndjson(std::string_view body, std::vector<ingest_source>& out);
+
+} // namespace btd
@@ -3,6 +3,9 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/strand.hpp>
 
+#include <memory>
+#include <string>
+
 #include "net.hpp"
 
 namespace btd {
@@ -14,20 +17,35 @@ class httpCaller;
 class listener : public std::enable_shared_from_this<listener>
 {
     net::io_context& ioc_;
-    tcp::acceptor acceptor_;
+    stream_acceptor acceptor_;
     std::shared_ptr<httpCaller> caller_;
+    // one of several acceptors sharing the port, each on its own
+    // single threaded io_context, so sessions need no strand
+    bool const reuse_port_;
+
+    net::any_io_executor session_executor();
 
     void fail(beast::error_code ec, char const* what);
-    void on_accept(beast::error_code ec, tcp::socket socket);
+    void on_accept(beast::error_code ec, stream_protocol::socket socket);
 
 public:
     listener(
         net::io_context& ioc,
-        tcp::endpoint endpoint,
-        std::shared_ptr<httpCaller> const& caller);
+        stream_protocol::endpoint endpoint,
+        std::shared_ptr<httpCaller> const& caller,
+        bool reuse_port = false);
 
     // Start accepting incoming connections
     void run();
 };
 
+// A listener on a unix domain socket at path, a stale socket file is
+// replaced and the new one gets mode. nullptr when it is unsupported.
+std::shared_ptr<listener>
+make_unix_listener(
+    net::io_context& ioc,
+    std::string const& path,
+    unsigned mode,
+    std::shared_ptr<httpCaller> const& caller);
+
 } // namespace btd
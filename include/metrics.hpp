@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <libtorrent/span.hpp>
+
+namespace btd {
+
+// Appends samples in the Prometheus text format (0.0.4) to out
+class prom_writer
+{
+    std::string& out_;
+
+    void
+    value(std::int64_t v);
+    void
+    value(double v);
+
+public:
+    explicit prom_writer(std::string& out)
+        : out_(out)
+    {}
+
+    // "# TYPE name type", once before the samples of name
+    void
+    type(std::string_view name, std::string_view type);
+
+    // labels as `pool="queries"`, without the braces
+    template<class T>
+    void
+    sample(std::string_view name, T v, std::string_view labels = {})
+    {
+        out_.append(name);
+        if (!labels.empty())
+        {
+            out_.push_back('{');
+            out_.append(labels);
+            out_.push_back('}');
+        }
+        out_.push_back(' ');
+        value(v);
+        out_.push_back('\n');
+    }
+
+    template<class T>
+    void
+    counter(std::string_view name, T v)
+    {
+        type(name, "counter");
+        sample(name, v);
+    }
+
+    template<class T>
+    void
+    gauge(std::string_view name, T v)
+    {
+        type(name, "gauge");
+        sample(name, v);
+    }
+};
+
+/** Every libtorrent session counter as Prometheus text
+
+    Rendered on the alert thread from each session_stats_alert into a
+    buffer no scrape holds any more, then published as the snapshot, so
+    a scrape only copies a shared_ptr and never waits on the session.
+*/
+class session_metrics
+{
+    struct metric
+    {
+        std::string head; // "# TYPE ... \n" and the sample name
+        int index;
+    };
+    std::vector<metric> metrics_;
+
+    // one being published, others still read by slow scrapes
+    std::array<std::shared_ptr<std::string>, 3> bufs_;
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<std::string const> current_;
+
+public:
+    std::atomic_int64_t renders{0};
+    std::atomic_int64_t render_us{0};
+    std::atomic_int64_t updated_us{0}; // steady clock of the last render
+
+    session_metrics();
+
+    void
+    update(lt::span<std::int64_t const> counters);
+
+    // the last rendering, empty before the first session_stats_alert
+    std::shared_ptr<std::string const>
+    snapshot() const;
+};
+
+} // namespace btd
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core/basic_stream.hpp>
 #include <boost/beast/core/error.hpp>
 #include <boost/beast/http/error.hpp>
 #include <boost/beast/websocket/error.hpp>
@@ -11,3 +14,8 @@ using tcp = boost::asio::ip::tcp;
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace websocket = beast::websocket;
+
+// tcp and unix domain connections share the session code
+using stream_protocol = boost::asio::generic::stream_protocol;
+using stream_acceptor = boost::asio::basic_socket_acceptor<stream_protocol>;
+using http_stream = beast::basic_stream<stream_protocol>;
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
@@ -9,6 +13,7 @@ namespace po = boost::program_options;
 #include <libtorrent/session.hpp>
 
 #include "const.hpp"
+#include "thread_util.hpp"
 #include "util.hpp"
 
 namespace btd {
@@ -26,8 +31,32 @@ struct Option {
     std::string movedRoot = "";
     std::string storeRoot = "";
     std::string webuiRoot = "";
+    std::string watchDirs = "";
     std::string httpAddr = "127.0.0.1";
+    std::string httpUnix = "";
+    unsigned httpUnixMode = 0660;
     std::uint_least16_t httpPort = 16180;
+    int saveDeadline = S_SAVE_DEADLINE;
+    int compressLevel = COMPRESS_LEVEL;
+    int httpThreads = std::max<int>(1, std::thread::hardware_concurrency()/2 -1);
+    int queryThreads = QUERY_WORKERS;
+    int diskThreads = 0; // libtorrent default
+    bool reusePort = false;
+
+    // dht is off unless asked for, the rest are dht_settings
+    bool dht = false;
+    int dhtUploadRate = 8000; // bytes/s
+    int dhtMaxPeers = 500;    // per torrent in the dht store
+    bool dhtPrivacy = true;
+
+    // take trackers of failing hosts out of all torrents for a while
+    bool trackerSuppress = true;
+
+    // cpus to pin each group of threads to, empty for no pinning
+    std::vector<int> cpuHttp;
+    std::vector<int> cpuAlert;
+    std::vector<int> cpuTorrent;
+    std::vector<int> cpuBlocking;
 
 	lt::session_params params;
 
@@ -45,10 +74,28 @@ std::string mapper(std::string env_var)
 
    if (env_var == ENV_PEERID_PREFIX || env_var == "TR_PEERID_PREFIX") return "peer-id";
    if (env_var == ENV_BOOTSTRAP_NODES) return "dht-bootstrap-nodes";
+   if (env_var == ENV_DHT) return "dht";
+   if (env_var == ENV_DHT_UPLOAD_RATE) return "dht-upload-rate";
+   if (env_var == ENV_DHT_MAX_PEERS) return "dht-max-peers";
+   if (env_var == ENV_DHT_PRIVACY) return "dht-privacy";
+   if (env_var == ENV_TRACKER_SUPPRESS) return "tracker-suppress";
    if (env_var == ENV_MOVED_ROOT) return "moved-root";
    if (env_var == ENV_STORE_ROOT) return "store-root";
    if (env_var == ENV_WEBUI_ROOT) return "webui-root";
    if (env_var == ENV_HTTP_ADDR) return "http-addr";
+   if (env_var == ENV_HTTP_UNIX) return "http-unix";
+   if (env_var == ENV_HTTP_UNIX_MODE) return "http-unix-mode";
+   if (env_var == ENV_SAVE_DEADLINE) return "save-deadline";
+   if (env_var == ENV_WATCH_DIRS) return "watch-dirs";
+   if (env_var == ENV_COMPRESS_LEVEL) return "compress-level";
+   if (env_var == ENV_HTTP_THREADS) return "http-threads";
+   if (env_var == ENV_QUERY_THREADS) return "query-threads";
+   if (env_var == ENV_HTTP_REUSEPORT) return "http-reuseport";
+   if (env_var == ENV_DISK_THREADS) return "disk-threads";
+   if (env_var == ENV_CPU_HTTP) return "cpu-http";
+   if (env_var == ENV_CPU_ALERT) return "cpu-alert";
+   if (env_var == ENV_CPU_TORRENT) return "cpu-torrent";
+   if (env_var == ENV_CPU_BLOCKING) return "cpu-blocking";
 #ifndef __APPLE__
    if (env_var == ENV_HTTP_PORT) return "http-port";
 #endif
@@ -67,7 +114,25 @@ Option::init_from(int argc, char* argv[])
         ("webui-root", po::value<std::string>(&webuiRoot)->default_value(getWebUI()), "web UI root, env: " ENV_WEBUI_ROOT)
         ("peer-id", po::value<std::string>(&peerID)->default_value("-LT-"), "set prefix of fingerprint, env: " ENV_PEERID_PREFIX)
         ("dht-bootstrap-nodes", po::value<std::string>()->default_value("dht.transmissionbt.com:6881"), "a comma-separated list of Host port-pairs. env: " ENV_BOOTSTRAP_NODES)
-        ("http-addr", po::value<std::string>()->default_value("127.0.0.1"), "http listen address, env: " ENV_HTTP_ADDR)
+        ("dht", po::value<bool>(&dht)->default_value(false)->implicit_value(true), "enable the DHT, its routing table is saved for a warm start, env: " ENV_DHT)
+        ("dht-upload-rate", po::value<int>(&dhtUploadRate)->default_value(8000), "bytes/s of DHT traffic, env: " ENV_DHT_UPLOAD_RATE)
+        ("dht-max-peers", po::value<int>(&dhtMaxPeers)->default_value(500), "peers stored per torrent for other nodes, env: " ENV_DHT_MAX_PEERS)
+        ("dht-privacy", po::value<bool>(&dhtPrivacy)->default_value(true)->implicit_value(true), "privacy lookups, env: " ENV_DHT_PRIVACY)
+        ("tracker-suppress", po::value<bool>(&trackerSuppress)->default_value(true)->implicit_value(true), "take trackers of hosts that keep failing out of all torrents for a while, env: " ENV_TRACKER_SUPPRESS)
+        ("http-addr", po::value<std::string>(&httpAddr)->default_value("127.0.0.1"), "http listen address, none for the unix socket only, env: " ENV_HTTP_ADDR)
+        ("http-unix", po::value<std::string>(&httpUnix), "path of a unix domain socket to serve http on too, env: " ENV_HTTP_UNIX)
+        ("http-unix-mode", po::value<std::string>()->default_value("660"), "octal file mode of the unix socket, env: " ENV_HTTP_UNIX_MODE)
+        ("watch-dirs", po::value<std::string>(&watchDirs), "a comma-separated list of dir[=save_path] to ingest .torrent files from, env: " ENV_WATCH_DIRS)
+        ("save-deadline", po::value<int>(&saveDeadline)->default_value(S_SAVE_DEADLINE), "seconds to flush resume data on shutdown, env: " ENV_SAVE_DEADLINE)
+        ("compress-level", po::value<int>(&compressLevel)->default_value(COMPRESS_LEVEL), "gzip level of large API responses, 0 to disable, env: " ENV_COMPRESS_LEVEL)
+        ("http-threads", po::value<int>(&httpThreads)->default_value(httpThreads), "threads running the http server, env: " ENV_HTTP_THREADS)
+        ("http-reuseport", po::value<bool>(&reusePort)->default_value(false)->implicit_value(true), "one io_context and SO_REUSEPORT acceptor per http thread, env: " ENV_HTTP_REUSEPORT)
+        ("query-threads", po::value<int>(&queryThreads)->default_value(QUERY_WORKERS), "threads running API calls that query the session, env: " ENV_QUERY_THREADS)
+        ("disk-threads", po::value<int>(&diskThreads)->default_value(0), "libtorrent disk threads, 0 for its default, env: " ENV_DISK_THREADS)
+        ("cpu-http", po::value<std::string>(), "cpus of the http threads as 0-3,8, env: " ENV_CPU_HTTP)
+        ("cpu-alert", po::value<std::string>(), "cpus of the alert loop, env: " ENV_CPU_ALERT)
+        ("cpu-torrent", po::value<std::string>(), "cpus of the libtorrent network and disk threads, env: " ENV_CPU_TORRENT)
+        ("cpu-blocking", po::value<std::string>(), "cpus of the query and compression pools, env: " ENV_CPU_BLOCKING)
 #ifndef __APPLE__
         ("http-port", po::value<std::uint_least16_t>(&httpPort)->default_value(16180), "http listen port, env: " ENV_HTTP_PORT)
 #endif
@@ -109,6 +174,22 @@ Option::init_from(int argc, char* argv[])
         LOG_DEBUG << "set dht-bootstrap-nodes " << nodes;
         params.settings.set_str(settings_pack::dht_bootstrap_nodes, nodes);
     }
+    params.settings.set_bool(settings_pack::enable_dht, dht);
+#ifndef TORRENT_DISABLE_DHT
+    if (dht)
+    {
+        params.dht_settings.upload_rate_limit = dhtUploadRate;
+        params.dht_settings.max_peers = dhtMaxPeers;
+        params.dht_settings.privacy_lookups = dhtPrivacy;
+        LOG_DEBUG << "set dht upload rate " << dhtUploadRate << " max peers " << dhtMaxPeers
+                  << (dhtPrivacy ? " privacy" : "") << ", " << params.dht_state.nodes.size()
+                  + params.dht_state.nodes6.size() << " saved nodes";
+    }
+#endif
+    if (vm.count("tracker-suppress"))
+    {
+        LOG_DEBUG << "set tracker suppress " << (trackerSuppress ? "on" : "off");
+    }
     if (vm.count("moved-root"))
     {
         LOG_DEBUG << "set moved root " << movedRoot;
@@ -121,6 +202,53 @@ Option::init_from(int argc, char* argv[])
     {
     	LOG_DEBUG << "set http addr " << httpAddr;
     }
+    if (vm.count("http-unix"))
+    {
+        auto const mode = vm["http-unix-mode"].as<std::string>();
+        auto const [ptr, ec] = std::from_chars(mode.data(), mode.data() + mode.size(), httpUnixMode, 8);
+        if (ec != std::errc() || ptr != mode.data() + mode.size() || httpUnixMode > 0777)
+        {
+            std::cerr << "invalid http-unix-mode: " << mode << std::endl;
+            return false;
+        }
+        LOG_DEBUG << "set http unix " << httpUnix << " mode " << mode;
+    }
+    if (vm.count("watch-dirs"))
+    {
+        LOG_DEBUG << "set watch dirs " << watchDirs;
+    }
+    if (vm.count("save-deadline"))
+    {
+        LOG_DEBUG << "set save deadline " << saveDeadline << "s";
+    }
+    if (vm.count("compress-level"))
+    {
+        LOG_DEBUG << "set compress level " << compressLevel;
+    }
+    httpThreads = std::max(1, httpThreads);
+    queryThreads = std::max(1, queryThreads);
+    LOG_DEBUG << "set threads http " << httpThreads << " query " << queryThreads
+              << (reusePort ? " reuseport" : "");
+    if (diskThreads > 0)
+    {
+        LOG_DEBUG << "set disk threads " << diskThreads;
+        params.settings.set_int(settings_pack::aio_threads, diskThreads);
+    }
+    for (auto const& [name, cpus] : {
+        std::pair<char const*, std::vector<int>*>{"cpu-http", &cpuHttp}
+        , {"cpu-alert", &cpuAlert}
+        , {"cpu-torrent", &cpuTorrent}
+        , {"cpu-blocking", &cpuBlocking}})
+    {
+        if (!vm.count(name)) continue;
+        auto const list = vm[name].as<std::string>();
+        if (!parse_cpu_list(list, *cpus))
+        {
+            std::cerr << "invalid cpu list of " << name << ": " << list << std::endl;
+            return false;
+        }
+        LOG_DEBUG << "set " << name << " " << list;
+    }
 
     return true;
 }
@@ -128,8 +256,31 @@ Option::init_from(int argc, char* argv[])
 std::shared_ptr<sheath>
 Option::make_context() const
 {
+#ifndef TORRENT_DISABLE_DHT
+    auto const warm = params.dht_state.nodes.size() + params.dht_state.nodes6.size();
+#endif
     const auto ses = std::make_shared<lt::session>(std::move(params));
     const auto ctx = std::make_shared<sheath>(ses, storeRoot, movedRoot);
+#ifndef TORRENT_DISABLE_DHT
+    ctx->set_dht_warm_nodes(int(warm));
+#endif
+    ctx->set_save_deadline(saveDeadline);
+    ctx->set_tracker_suppress(trackerSuppress);
+
+    // dir[=save_path],...
+    std::string_view dirs(watchDirs);
+    while (!dirs.empty())
+    {
+        auto const comma = dirs.find(',');
+        auto const item = dirs.substr(0, comma);
+        dirs = comma == std::string_view::npos ? std::string_view{} : dirs.substr(comma + 1);
+        if (item.empty()) continue;
+        auto const eq = item.find('=');
+        if (eq == std::string_view::npos)
+            ctx->add_watch_dir(std::string(item), "");
+        else
+            ctx->add_watch_dir(std::string(item.substr(0, eq)), std::string(item.substr(eq + 1)));
+    }
     return ctx;
 }
 
@@ -145,7 +296,7 @@ load_sess_params(std::string const& cd, lt::session_params& params)
         lt::bdecode_node e = lt::bdecode(in, ec);
         lt::session::save_state_flags_t sft = lt::session::save_settings;
 #ifndef TORRENT_DISABLE_DHT
-        params.dht_settings.privacy_lookups = true;
+        // the routing table of the last run, to bootstrap from
         sft |= lt::session::save_dht_state;
 #endif
 
@@ -177,11 +328,12 @@ load_sess_params(std::string const& cd, lt::session_params& params)
         | lt::alert_category::incoming_request
         | lt::alert_category::dht_operation
         | lt::alert_category::port_mapping_log
-        | lt::alert_category::file_progress);
+        | lt::alert_category::file_progress
+        | lt::alert_category::piece_progress);
 
     settings.set_bool(settings_pack::enable_upnp, false);
     settings.set_bool(settings_pack::enable_natpmp, false);
-    settings.set_bool(settings_pack::enable_dht, false);
+    settings.set_bool(settings_pack::enable_dht, false); // --dht
     settings.set_bool(settings_pack::enable_lsd, false);
     settings.set_bool(settings_pack::validate_https_trackers, false);
 }
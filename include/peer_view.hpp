@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <libtorrent/address.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/torrent_handle.hpp>
+
+namespace btd {
+
+/** Connected peers of every torrent, grouped for /api/peers
+
+    A sweep visits up to PEERS_SWEEP_TORRENTS of the torrents with
+    peers, round robin, so a large session is covered over a few
+    rounds; a torrent keeps its last sample until visited again. Each
+    sweep renders the groups into a snapshot that readers share.
+*/
+class peer_view
+{
+public:
+    struct peer
+    {
+        std::string client;
+        lt::address addr;
+        std::uint16_t port;
+        int up;   // bytes/s
+        int down;
+        bool utp;
+    };
+
+    // set by the alert loop while a sweep is queued or running
+    std::atomic_bool sweeping{false};
+    // seconds of lt::clock_type until which sweeps run
+    std::atomic_int64_t watched_until{0};
+    std::atomic_int64_t sweeps{0};
+    std::atomic_int64_t sweep_us{0};
+
+    // from a background thread, active are the torrents with peers
+    void
+    sweep(std::vector<std::pair<lt::sha1_hash, lt::torrent_handle>> const& active);
+
+    // the last rendering, null before the first sweep
+    std::shared_ptr<std::string const>
+    snapshot() const;
+
+private:
+    std::string
+    render(std::size_t torrents) const;
+
+    // only touched by sweep, which never runs twice at once
+    std::unordered_map<lt::sha1_hash, std::vector<peer>> peers_;
+    std::size_t cursor_ = 0;
+
+    mutable std::mutex mutex_;
+    std::shared_ptr<std::string const> snapshot_;
+};
+
+} // namespace btd
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <libtorrent/sha1_hash.hpp>
+
+namespace btd {
+
+/*  Encodings of per-piece maps, smallest wins
+
+    "bits": one bit per piece, most significant first as in the
+    BitTorrent bitfield message. "bytes": one byte per piece, clamped
+    to 255. "rle": runs of (LEB128 length, value byte). All base64.
+*/
+
+// {"encoding":"bits"|"rle","data":...} of a have-bitfield
+std::string
+encode_have(std::vector<bool> const& have);
+
+// {"encoding":"bytes"|"rle","data":...} of counts per piece
+std::string
+encode_counts(std::vector<int> const& counts);
+
+/** Rendered /pieces responses of recently asked torrents
+
+    An entry lasts until a piece of its torrent finishes or, as peers
+    come and go, PIECES_CACHE_TTL passes.
+*/
+class piece_cache
+{
+    struct entry
+    {
+        std::shared_ptr<std::string const> body;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    mutable std::mutex mutex_;
+    std::unordered_map<lt::sha1_hash, entry> entries_;
+
+public:
+    std::shared_ptr<std::string const>
+    find(lt::sha1_hash const& ih) const;
+
+    void
+    store(lt::sha1_hash const& ih, std::shared_ptr<std::string const> body);
+
+    void
+    invalidate(lt::sha1_hash const& ih);
+};
+
+} // namespace btd
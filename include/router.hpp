@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/beast/http/verb.hpp>
+
+#include "net.hpp"
+
+namespace btd {
+
+// Path parameters of a matched route, views into the request target
+class route_params
+{
+    static constexpr std::size_t max_params = 4;
+    std::array<std::pair<std::string_view, std::string_view>, max_params> items_{};
+    std::size_t size_ = 0;
+
+    template<class> friend class router;
+
+    bool
+    push(std::string_view name, std::string_view value) noexcept
+    {
+        if (size_ == max_params) return false;
+        items_[size_++] = {name, value};
+        return true;
+    }
+
+public:
+    // value of {name}, empty when the route has no such parameter
+    std::string_view
+    operator[](std::string_view name) const noexcept
+    {
+        for (std::size_t i = 0; i < size_; ++i)
+            if (items_[i].first == name) return items_[i].second;
+        return {};
+    }
+
+    std::size_t
+    size() const noexcept
+    {
+        return size_;
+    }
+};
+
+// Kind of a {param} segment, from its name
+enum class param_kind : std::uint8_t
+{
+    segment,   // any non-empty segment
+    info_hash, // {info_hash}: 40 hex or 32 base32 digits
+    number     // {id}, {index}: decimal digits
+};
+
+/** Routes of the API, built once then matched without allocating
+
+    Patterns are split on '/' into a trie. A static segment wins over
+    a {param} at the same depth, so "/torrents/batch" and "/torrents/{x}"
+    can coexist. Each node keeps its handlers by method, a path that
+    matches with no handler for the method is reported as such so the
+    caller can answer 405 with an Allow header.
+*/
+template<class Handler>
+class router
+{
+    struct node
+    {
+        std::vector<std::pair<std::string, std::unique_ptr<node>>> statics;
+        std::unique_ptr<node> param;
+        std::string param_name;
+        param_kind kind = param_kind::segment;
+        std::vector<std::pair<http::verb, Handler>> methods;
+    };
+
+    node root_;
+
+    static param_kind
+    kind_of(std::string_view name) noexcept
+    {
+        if (name == "info_hash") return param_kind::info_hash;
+        if (name == "id" || name == "index") return param_kind::number;
+        return param_kind::segment;
+    }
+
+    static bool
+    accepts(param_kind kind, std::string_view seg) noexcept
+    {
+        switch (kind) {
+        case param_kind::info_hash:
+            return seg.size() == 40 || seg.size() == 32;
+        case param_kind::number:
+            if (seg.empty()) return false;
+            for (char const c : seg)
+                if (c < '0' || c > '9') return false;
+            return true;
+        case param_kind::segment:
+            return !seg.empty();
+        }
+        return false;
+    }
+
+    // next segment of path, consumed
+    static std::string_view
+    next_segment(std::string_view& path) noexcept
+    {
+        if (!path.empty() && path.front() == '/') path.remove_prefix(1);
+        auto const slash = path.find('/');
+        auto const seg = path.substr(0, slash);
+        path = slash == std::string_view::npos ? std::string_view{} : path.substr(slash);
+        return seg;
+    }
+
+    node const*
+    find(std::string_view path, route_params& params) const noexcept
+    {
+        node const* n = &root_;
+        while (!path.empty() && path != "/")
+        {
+            auto const seg = next_segment(path);
+            node const* next = nullptr;
+            for (auto const& [name, child] : n->statics)
+            {
+                if (name == seg) { next = child.get(); break; }
+            }
+            if (!next && n->param && accepts(n->param->kind, seg)
+                && params.push(n->param_name, seg))
+                next = n->param.get();
+            if (!next) return nullptr;
+            n = next;
+        }
+        return n;
+    }
+
+public:
+    enum class result : std::uint8_t
+    {
+        found,
+        not_found,
+        method_not_allowed
+    };
+
+    // pattern as "/torrent/{info_hash}/{act}"
+    void
+    add(http::verb method, std::string_view pattern, Handler handler)
+    {
+        node* n = &root_;
+        while (!pattern.empty() && pattern != "/")
+        {
+            auto const seg = next_segment(pattern);
+            if (seg.size() > 2 && seg.front() == '{' && seg.back() == '}')
+            {
+                auto const name = seg.substr(1, seg.size() - 2);
+                if (!n->param)
+                {
+                    n->param = std::make_unique<node>();
+                    n->param_name = std::string(name);
+                    n->param->kind = kind_of(name);
+                }
+                n = n->param.get();
+                continue;
+            }
+            node* next = nullptr;
+            for (auto& [name, child] : n->statics)
+            {
+                if (name == seg) { next = child.get(); break; }
+            }
+            if (!next)
+            {
+                n->statics.emplace_back(std::string(seg), std::make_unique<node>());
+                next = n->statics.back().second.get();
+            }
+            n = next;
+        }
+        n->methods.emplace_back(method, std::move(handler));
+    }
+
+    // handler of method on path, params point into path
+    result
+    match(http::verb method, std::string_view path, route_params& params,
+        Handler const*& handler) const noexcept
+    {
+        auto const n = find(path, params);
+        if (!n || n->methods.empty()) return result::not_found;
+        for (auto const& [m, h] : n->methods)
+        {
+            if (m == method)
+            {
+                handler = &h;
+                return result::found;
+            }
+        }
+        return result::method_not_allowed;
+    }
+
+    // "GET, PUT" for the Allow header of a 405
+    std::string
+    allowed(std::string_view path) const
+    {
+        route_params params;
+        std::string ret;
+        auto const n = find(path, params);
+        if (!n) return ret;
+        for (auto const& [m, h] : n->methods)
+        {
+            if (!ret.empty()) ret.append(", ");
+            ret.append(http::to_string(m));
+        }
+        return ret;
+    }
+};
+
+} // namespace btd
@@ -16,6 +16,10 @@ struct sessionStats
     int64_t bytesDataSent;
     int64_t rateRecv;
     int64_t rateSent;
+    int64_t rateRecv10s; // averaged over 10s, rateRecv over 1s
+    int64_t rateSent10s;
+    int64_t rateRecv60s;
+    int64_t rateSent60s;
     int64_t bytesFailed;
     int64_t bytesWasted;
     int64_t bytesQueued;
@@ -49,6 +53,10 @@ struct sessionStats
 	    if (bytesDataSent > 0) obj.emplace("bytesDataSent", bytesDataSent);
 	    if (rateRecv > 0) obj.emplace("rateRecv", rateRecv);
 	    if (rateSent > 0) obj.emplace("rateSent", rateSent);
+	    if (rateRecv10s > 0) obj.emplace("rateRecv10s", rateRecv10s);
+	    if (rateSent10s > 0) obj.emplace("rateSent10s", rateSent10s);
+	    if (rateRecv60s > 0) obj.emplace("rateRecv60s", rateRecv60s);
+	    if (rateSent60s > 0) obj.emplace("rateSent60s", rateSent60s);
 	    if (bytesFailed > 0) obj.emplace("bytesFailed", bytesFailed);
 	    if (bytesQueued > 0) obj.emplace("bytesQueued", bytesQueued);
 	    if (bytesWasted > 0) obj.emplace("bytesWasted", bytesWasted);
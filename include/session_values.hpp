@@ -1,5 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include <libtorrent/config.hpp>
 
@@ -9,13 +17,23 @@ namespace btd {
 
 class sessionValues {
 
-    // there are two sets of counters. the current one and the last one. This
-    // is used to calculate rates
-    std::vector<std::int64_t> m_cnt[2];
+    // time constants of the rate averages, seconds
+    static constexpr double m_windows[] = {1.0, 10.0, 60.0};
+    static constexpr std::size_t m_num_windows = std::size(m_windows);
 
-    // the timestamps of the counters in m_cnt[0] and m_cnt[1]
-    // respectively. The timestamps are microseconds since session start
-    std::uint64_t m_timestamp[2];
+    // owned by the alert thread: the previous counters and their
+    // timestamp, microseconds, and the per second averages of the deltas
+    std::vector<std::int64_t> m_prev;
+    std::uint64_t m_prev_t = 0;
+    std::vector<double> m_delta;
+    std::vector<double> m_ewma[m_num_windows];
+    int m_samples = 0;
+
+    // what readers see, the counters then the rates of each window,
+    // behind a seqlock: odd while updateCounters is writing
+    std::size_t m_size = 0;
+    std::unique_ptr<std::atomic<std::int64_t>[]> m_pub;
+    std::atomic<std::uint64_t> m_seq{0};
 
 
     int const m_num_checking_idx = lt::find_metric_idx("ses.num_checking_torrents");
@@ -67,70 +85,143 @@ class sessionValues {
     int const m_queued_tracker_announces = lt::find_metric_idx("tracker.num_queued_tracker_announces");
 
 public:
+    // reads of one consistent snapshot, given to sessionValues::read
+    class view
+    {
+        std::atomic<std::int64_t> const* m_pub;
+        std::size_t m_size;
+
+        friend class sessionValues;
+        view(std::atomic<std::int64_t> const* pub, std::size_t size)
+            : m_pub(pub), m_size(size)
+        {}
+
+    public:
+        std::int64_t
+        operator[](int idx) const noexcept
+        {
+            return idx < 0 || std::size_t(idx) >= m_size ? 0 : m_pub[idx].load(std::memory_order_relaxed);
+        }
+
+        // per second, averaged over m_windows[window]
+        std::int64_t
+        rate(int idx, std::size_t window) const noexcept
+        {
+            if (idx < 0 || std::size_t(idx) >= m_size) return 0;
+            return m_pub[(1 + window) * m_size + idx].load(std::memory_order_relaxed);
+        }
+    };
+
     explicit
     sessionValues()
     {
-        std::vector<lt::stats_metric> metrics = lt::session_stats_metrics();
-        m_cnt[0].resize(metrics.size(), 0);
-        m_cnt[1].resize(metrics.size(), 0);
+        m_size = lt::session_stats_metrics().size();
+        m_prev.resize(m_size, 0);
+        m_delta.resize(m_size, 0.0);
+        for (auto& e : m_ewma) e.resize(m_size, 0.0);
+        m_pub = std::make_unique<std::atomic<std::int64_t>[]>((1 + m_num_windows) * m_size);
     }
 
+    // from the alert thread only, t in microseconds
     void
     updateCounters(lt::span<std::int64_t const> sc, std::uint64_t t)
     {
-        // only update the previous counters if there's been enough
-        // time since it was last updated
-        if (t - m_timestamp[1] > 2000000)
+        auto const n = std::min(std::size_t(sc.size()), m_size);
+        std::int64_t const* cnt = sc.data();
+
+        double const dt = m_samples > 0 && t > m_prev_t ? (t - m_prev_t) / 1e6 : 0.0;
+        if (dt > 0)
         {
-            m_cnt[1].swap(m_cnt[0]);
-            m_timestamp[1] = m_timestamp[0];
+            // plain loops over all counters, left to the vectorizer
+            double const inv = 1.0 / dt;
+            double* delta = m_delta.data();
+            std::int64_t const* prev = m_prev.data();
+            for (std::size_t i = 0; i < n; ++i) delta[i] = double(cnt[i] - prev[i]) * inv;
+
+            for (std::size_t w = 0; w < m_num_windows; ++w)
+            {
+                // the first rate seeds the averages instead of ramping from zero
+                double const a = m_samples == 1 ? 1.0 : 1.0 - std::exp(-dt / m_windows[w]);
+                double* e = m_ewma[w].data();
+                for (std::size_t i = 0; i < n; ++i) e[i] += a * (delta[i] - e[i]);
+            }
         }
+        std::copy(cnt, cnt + n, m_prev.begin());
+        m_prev_t = t;
+        if (dt > 0 || m_samples == 0) ++m_samples;
+
+        auto const seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < n; ++i) m_pub[i].store(cnt[i], std::memory_order_relaxed);
+        for (std::size_t w = 0; w < m_num_windows; ++w)
+        {
+            auto* out = m_pub.get() + (1 + w) * m_size;
+            for (std::size_t i = 0; i < n; ++i)
+                out[i].store(std::llround(m_ewma[w][i]), std::memory_order_relaxed);
+        }
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
 
-        m_cnt[0].assign(sc.begin(), sc.end());
-        m_timestamp[0] = t;
+    /** f(view) on a consistent snapshot, without locking
+
+        f is run again if updateCounters published meanwhile, so it
+        should only copy out of the view. false before the first update.
+    */
+    template<class F>
+    bool
+    read(F&& f) const
+    {
+        for (;;)
+        {
+            auto const seq = m_seq.load(std::memory_order_acquire);
+            if (seq == 0) return false;
+            if (seq & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            f(view(m_pub.get(), m_size));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_seq.load(std::memory_order_relaxed) == seq) return true;
+        }
     }
 
     sessionStats
     getSessionStats() const
     {
-        sessionStats s;
-        if (m_cnt[0].size() < m_queued_tracker_announces)
-        {
-            std::cerr << "ctx empty stats: " << m_cnt[0].size() << std::endl;
-            return s;
-        }
-        s.numChecking = int(m_cnt[0][m_num_checking_idx]);
-        s.numDownloading = int(m_cnt[0][m_num_downloading_idx]);
-        s.numSeeding = int(m_cnt[0][m_num_seeding_idx]);
-        s.numStopped = int(m_cnt[0][m_num_stopped_idx]);
-        s.numQueued = int(m_cnt[0][m_num_queued_seeding_idx] + m_cnt[0][m_num_queued_download_idx]);
-        s.numError = int(m_cnt[0][m_num_error_idx]);
-
-        s.bytesRecv = std::uint64_t(m_cnt[0][m_recv_idx]);
-        s.bytesSent = std::uint64_t(m_cnt[0][m_sent_idx]);
-        s.bytesDataRecv = std::uint64_t(m_cnt[0][m_recv_data_idx]);
-        s.bytesDataSent = std::uint64_t(m_cnt[0][m_send_data_idx]);
-
-        if (m_cnt[1].size() >= m_send_data_idx)
+        sessionStats s{};
+        read([&](view const& v)
         {
-            float const seconds = (m_timestamp[0] - m_timestamp[1]) / 1000000.f;
-            int const download_rate = int((m_cnt[0][m_recv_idx] - m_cnt[1][m_recv_idx])
-                / seconds);
-            int const upload_rate = int((m_cnt[0][m_sent_idx] - m_cnt[1][m_sent_idx])
-                / seconds);
-            s.rateRecv = download_rate;
-            s.rateSent = upload_rate;
-        }
-
-        s.bytesFailed = std::uint64_t(m_cnt[0][m_failed_bytes_idx]);
-        s.bytesQueued = std::uint64_t(m_cnt[0][m_queued_bytes_idx]);
-        s.bytesWasted = std::uint64_t(m_cnt[0][m_wasted_bytes_idx]);
-        s.numPeersConnected = int(m_cnt[0][m_num_peers_connected_idx]);
-        s.numPeersHalfOpen = int(m_cnt[0][m_num_peers_half_open_idx]);
-        s.limitUpQueue = int(m_cnt[0][m_limiter_up_queue_idx]);
-        s.limitDownQueue = int(m_cnt[0][m_limiter_down_queue_idx]);
-        s.queuedTrackerAnnounces = int(m_cnt[0][m_queued_tracker_announces]);
-        s.hasIncoming = int(m_cnt[0][m_has_incoming_idx]);
+            s.numChecking = int(v[m_num_checking_idx]);
+            s.numDownloading = int(v[m_num_downloading_idx]);
+            s.numSeeding = int(v[m_num_seeding_idx]);
+            s.numStopped = int(v[m_num_stopped_idx]);
+            s.numQueued = int(v[m_num_queued_seeding_idx] + v[m_num_queued_download_idx]);
+            s.numError = int(v[m_num_error_idx]);
+
+            s.bytesRecv = v[m_recv_idx];
+            s.bytesSent = v[m_sent_idx];
+            s.bytesDataRecv = v[m_recv_data_idx];
+            s.bytesDataSent = v[m_send_data_idx];
+
+            s.rateRecv = v.rate(m_recv_idx, 0);
+            s.rateSent = v.rate(m_sent_idx, 0);
+            s.rateRecv10s = v.rate(m_recv_idx, 1);
+            s.rateSent10s = v.rate(m_sent_idx, 1);
+            s.rateRecv60s = v.rate(m_recv_idx, 2);
+            s.rateSent60s = v.rate(m_sent_idx, 2);
+
+            s.bytesFailed = v[m_failed_bytes_idx];
+            s.bytesQueued = v[m_queued_bytes_idx];
+            s.bytesWasted = v[m_wasted_bytes_idx];
+            s.numPeersConnected = int(v[m_num_peers_connected_idx]);
+            s.numPeersHalfOpen = int(v[m_num_peers_half_open_idx]);
+            s.limitUpQueue = int(v[m_limiter_up_queue_idx]);
+            s.limitDownQueue = int(v[m_limiter_down_queue_idx]);
+            s.queuedTrackerAnnounces = int(v[m_queued_tracker_announces]);
+            s.hasIncoming = v[m_has_incoming_idx] != 0;
+        });
         s.uptime = uptime();
         s.uptimeMs = uptimeMs();
         return std::move(s);
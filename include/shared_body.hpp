@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+
+#include "net.hpp"
+
+namespace btd {
+
+/** A body of immutable shared bytes
+
+    Many responses can send the same buffer, it is neither copied
+    nor freed while a write is in flight.
+*/
+struct shared_body
+{
+    using value_type = std::shared_ptr<std::string const>;
+
+    static std::uint64_t
+    size(value_type const& body) noexcept
+    {
+        return body ? body->size() : 0;
+    }
+
+    class writer
+    {
+        value_type const& body_;
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template<bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> const&, value_type const& body)
+            : body_(body)
+        {
+        }
+
+        void
+        init(beast::error_code& ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>>
+        get(beast::error_code& ec)
+        {
+            ec = {};
+            if (!body_ || body_->empty()) return boost::none;
+            return {{net::const_buffer(body_->data(), body_->size()), false}};
+        }
+    };
+};
+
+} // namespace btd
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <ctime>
 #include <filesystem>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/config.hpp>
 #include <boost/json/value.hpp>
 
@@ -21,8 +28,18 @@ namespace json = boost::json;
 #include <libtorrent/sha1_hash.hpp>
 #include <libtorrent/span.hpp>
 
+#include "file_table.hpp"
+#include "history.hpp"
+#include "ingest.hpp"
+#include "metrics.hpp"
+#include "peer_view.hpp"
+#include "piece_map.hpp"
 #include "session_stats.hpp"
 #include "session_values.hpp"
+#include "stream_pieces.hpp"
+#include "tracker_health.hpp"
+#include "thread_util.hpp"
+#include "util.hpp"
 
 // Forward declaration
 // class websocket_session;
@@ -39,6 +56,50 @@ tag_invoke( json::value_from_tag, json::value& jv, lt::torrent_status const& st)
 
 using query_flags_t = std::uint16_t;
 
+enum class batch_action : std::uint8_t
+{
+    pause,
+    resume,
+    toggle,
+    recheck,
+    remove,
+    remove_data
+};
+
+// where the payload of one file lives, for content streaming
+struct content_plan
+{
+    lt::torrent_handle th;
+    stream_pieces* pieces = nullptr;
+    lt::typed_bitfield have;      // when planned
+    bool seeding = false;
+    std::string path;             // the file on disk
+    std::int64_t file_offset = 0; // of the file within the torrent
+    std::int64_t file_size = 0;
+    int piece_length = 0;
+    int num_pieces = 0;
+};
+
+// a page of /files, all of them as a plain array unless paged
+struct file_query
+{
+    bool paged = false;
+    bool tree = false; // files right in dir, with its subdirectories
+    std::string dir;
+    int offset = 0;
+    int limit = FILES_PAGE_LIMIT;
+};
+
+// selects torrents from the cached status, unset fields match all
+struct torrent_filter
+{
+    std::optional<int> state; // lt::torrent_status::state_t
+    std::optional<bool> paused;
+    std::optional<bool> finished;
+    std::string save_path; // prefix
+    std::string name;      // substring
+};
+
 // Represents the shared server state
 struct sheath : public std::enable_shared_from_this<sheath>
 {
@@ -46,7 +107,13 @@ struct sheath : public std::enable_shared_from_this<sheath>
 
     static constexpr query_flags_t query_basic = 1;
     static constexpr query_flags_t query_peers = 2;
-    static constexpr query_flags_t query_files = 4;
+
+    // a directory to ingest .torrent files from, into its own save path
+    struct watch_dir
+    {
+        fs::path dir;
+        std::string save_path; // empty for the store root
+    };
 
     explicit
     sheath(std::shared_ptr<lt::session> const ses,
@@ -68,8 +135,9 @@ struct sheath : public std::enable_shared_from_this<sheath>
     json::value
     getSessionStats() const;
 
+    // with the last TORRENT_SPARK_POINTS history samples of each if spark
     json::value
-    get_torrents() const;
+    get_torrents(bool spark = false) const;
     json::value
     get_torrent(lt::sha1_hash const& ih, query_flags_t flags = query_basic) const;
     bool
@@ -81,8 +149,27 @@ struct sheath : public std::enable_shared_from_this<sheath>
     bool
     resume_torrent(lt::sha1_hash const& ih);
 
+    // apply one action to many torrents in a single pass
+    json::array
+    batch_torrents(batch_action act, std::vector<lt::sha1_hash> const& hashes);
+    std::vector<lt::sha1_hash>
+    filter_torrents(torrent_filter const& f) const;
+
+    // JSON of the files of a torrent, nullopt when there's no such torrent or dir
+    std::optional<std::string>
+    get_files(lt::sha1_hash const& ih, file_query const& q);
+
+    // have-bitfield and availability, encoded, null when there's no such torrent
+    std::shared_ptr<std::string const>
+    get_pieces(lt::sha1_hash const& ih);
+
+    bool
+    plan_content(lt::sha1_hash const& ih, int file_index, content_plan& plan) const;
+
     std::string
     resume_file(lt::sha1_hash const& info_hash) const;
+    std::string
+    metadata_file(lt::sha1_hash const& info_hash) const;
 
     bool
     set_peer(std::string const & addr);
@@ -92,6 +179,82 @@ struct sheath : public std::enable_shared_from_this<sheath>
     void
     save_all_resume();
     void
+    set_save_deadline(int s) noexcept
+    {
+        save_deadline = lt::seconds(s);
+    }
+    void
+    set_tracker_suppress(bool on) noexcept
+    {
+        trackers_.suppress = on;
+    }
+    json::object
+    getResumeStats() const;
+
+    // load of the resume writers and parsers
+    json::value
+    getPoolStats() const;
+
+    /* routing table and lookups of the last dht_stats_alert as JSON,
+       polled for DHT_WATCH_TTL seconds after each call; "stale" when
+       polling had stopped before it */
+    std::shared_ptr<std::string const>
+    getDhtStats();
+
+    /* connected peers of all torrents grouped as JSON, swept every
+       PEERS_SWEEP_INTERVAL for PEERS_WATCH_TTL seconds after each call;
+       "stale" when sweeps had stopped before it */
+    std::shared_ptr<std::string const>
+    getPeers();
+
+    // results of every tracker url and suppressed hosts, with the announce queue
+    json::value
+    getTrackers() const;
+#ifndef TORRENT_DISABLE_DHT
+    // nodes of the saved routing table the session starts from
+    void
+    set_dht_warm_nodes(int n) noexcept
+    {
+        dht_warm_nodes_ = n;
+    }
+    // from start to the dht_bootstrap_alert, -1 until then
+    std::int64_t
+    dht_bootstrap_ms() const noexcept
+    {
+        return dht_bootstrap_ms_.load();
+    }
+#endif
+
+    session_metrics const&
+    metrics() const noexcept
+    {
+        return metrics_;
+    }
+
+    tracker_health const&
+    trackers() const noexcept
+    {
+        return trackers_;
+    }
+
+    peer_view const&
+    peer_sweeps() const noexcept
+    {
+        return peers_;
+    }
+
+    session_history const&
+    history() const noexcept
+    {
+        return history_;
+    }
+
+    torrent_history const&
+    torrent_histories() const noexcept
+    {
+        return torrent_history_;
+    }
+    void
     start();
     void
     doLoop();
@@ -101,20 +264,64 @@ struct sheath : public std::enable_shared_from_this<sheath>
     bool
     add_magnet(std::string const& uri);
     bool
-    add_torrent(std::string const& filename);
+    add_torrent(std::string const& filename, std::string const& save_path = "");
     bool
     add_torrent(char const* buffer, int size, std::string const& save_path);
+    bool
+    add_torrent(std::shared_ptr<lt::torrent_info> ti, std::string const& save_path);
     json::value
     getSyncStats() const;
     bool
     toggle_pause_resume();
 
+    void
+    add_watch_dir(std::string const& dir, std::string const& save_path);
+    std::vector<watch_dir> const&
+    watch_dirs() const noexcept
+    {
+        return watches_;
+    }
+    // parse and add a watched file on the parsers_ pool, then remove it
+    void
+    ingest_file(std::string const& file, std::string const& save_path);
+    // queue a bulk body on parsers_ and return the job id to poll
+    std::uint64_t
+    ingest_bulk(std::string body, std::string content_type, std::string save_path);
+    std::shared_ptr<ingest_job const>
+    find_job(std::uint64_t id) const;
+
+    // an event watcher is feeding ingest_file, slow down the polling scan
+    void
+    set_watching(bool on) noexcept
+    {
+        watching_ = on;
+    }
+    void
+    rescan() noexcept
+    {
+        rescan_ = true;
+    }
+
 private:
     void
     load_resumes();
 
+    bool
+    load_resume(lt::sha1_hash const& ih, lt::add_torrent_params& p);
+
+    std::shared_ptr<lt::torrent_info>
+    load_metadata(lt::sha1_hash const& ih) const;
+
+    bool
+    save_metadata(lt::torrent_info const& ti) const;
+
     void
     save_session();
+    // session state with the dht routing table, off the alert thread
+    void
+    checkpoint_session();
+    void
+    write_session_state(std::vector<char> const& buf, std::uint64_t gen);
 
     void
     pop_alerts();
@@ -123,10 +330,48 @@ private:
     set_torrent_params(lt::add_torrent_params& p);
 
     void
-    scan_dir(std::string const& dir_path);
+    checkpoint();
+
+    // queue a peer_view sweep of the torrents with peers on parsers_
+    void
+    sweep_peers();
+
+    // take the trackers of host out of one torrent, or all without one,
+    // and give them back; both queued on tracker_worker_, in order
+    void
+    suppress_tracker(std::string host, lt::torrent_handle one);
+    void
+    restore_trackers(std::vector<std::string> hosts);
+
+    void
+    write_resume(lt::add_torrent_params const& atp);
+
+    void
+    scan_dir(watch_dir const& w);
+
+    void
+    ingest_batch(std::shared_ptr<ingest_job> const& job, std::size_t first, std::size_t last);
+    bool
+    prepare_ingest(ingest_source const& src, std::string const& save_path,
+        lt::add_torrent_params& p, std::string& err);
+    void
+    on_ingest_added(lt::add_torrent_alert const* a);
+
+    void
+    pause_resume_handle(lt::torrent_handle const& th, lt::torrent_flags_t flags);
+    void
+    resume_handle(lt::torrent_handle const& th, lt::torrent_flags_t flags);
 
     void
     remove_torrent_with_handle(const lt::torrent_handle th);
+    // no more resume writes for ih, whatever is still queued
+    void
+    mark_removed(lt::sha1_hash const& ih);
+    bool
+    is_removed(lt::sha1_hash const& ih) const;
+    // delete the resume file after the writes queued before
+    void
+    remove_resume(lt::sha1_hash const& ih);
     void
     set_all_torrents(const std::vector<lt::torrent_status> st);
     void
@@ -139,11 +384,20 @@ private:
     fs::path const dir_moved;
     fs::path const dir_store;
     fs::path const dir_resumes;
+    fs::path const dir_metas;
     fs::path const dir_watches;
     fs::path const file_ses_state;
     lt::tcp::endpoint* peer_ = nullptr; // prepared peer ip:port
 
     sessionValues  svs = sessionValues();
+    // every counter of the last session_stats_alert, for /metrics
+    session_metrics metrics_;
+    // rates and gauges over the last 30 days, for graphs
+    session_history history_;
+    // quantized samples of every torrent, for sparklines
+    torrent_history torrent_history_;
+    piece_cache pieces_;
+    file_cache files_;
     // all torrents - protected by mutex_
     std::unordered_map<lt::torrent_handle, lt::torrent_status> m_all_handles;
 
@@ -151,7 +405,51 @@ private:
 
     // the number of times we've asked to save resume data
     // without having received a response (successful or failure)
-    int num_outstanding_resume_data = 0;
+    std::atomic_int num_outstanding_resume_data{0};
+    // resume buffers handed to writers_ but not yet on disk
+    std::atomic_int num_pending_writes{0};
+    std::atomic_int64_t num_resume_saved{0};
+    std::atomic_int64_t num_resume_failed{0};
+    std::atomic_bool flushing{false};
+    std::atomic_bool flushed{false};
+
+    // load of the pools below, they outlive their tasks
+    pool_stats writer_stats_{RESUME_WRITERS};
+    pool_stats parser_stats_{PARSE_WORKERS};
+    pool_stats tracker_stats_{1};
+
+    // resume files are written off the alert thread, in parallel
+    boost::asio::thread_pool writers_{RESUME_WRITERS};
+    // all writes and the delete of one info-hash go through the same strand
+    using writer_strand = boost::asio::strand<boost::asio::thread_pool::executor_type>;
+    std::vector<writer_strand> write_strands_;
+    writer_strand&
+    strand_of(lt::sha1_hash const& ih)
+    {
+        return write_strands_[std::hash<lt::sha1_hash>{}(ih) % write_strands_.size()];
+    }
+    // removed torrents, until added again, an in-flight save must not bring them back
+    mutable std::mutex resume_mutex_;
+    std::unordered_set<lt::sha1_hash> removed_;
+    // loaded from resume files that still embed the info dict, saved once in full
+    std::unordered_set<lt::sha1_hash> embedded_;
+    void
+    mark_embedded(lt::sha1_hash const& ih);
+    // watched .torrent files are parsed off the alert and I/O threads
+    boost::asio::thread_pool parsers_{PARSE_WORKERS};
+
+    std::vector<watch_dir> watches_;
+    std::atomic_bool watching_{false};
+    std::atomic_bool rescan_{false};
+    // files queued on parsers_, an event and a scan may see the same one
+    std::mutex ingest_mutex_;
+    std::unordered_set<std::string> ingesting_;
+    // bulk items waiting for their add_torrent_alert
+    std::unordered_map<lt::sha1_hash, std::pair<std::weak_ptr<ingest_job>, std::size_t>> pending_ingest_;
+
+    mutable std::mutex jobs_mutex_;
+    std::map<std::uint64_t, std::shared_ptr<ingest_job>> jobs_;
+    std::uint64_t last_job_id = 0;
 
     // int torrent_upload_limit = 0;
     // int torrent_download_limit = 0;
@@ -161,12 +459,33 @@ private:
     lt::storage_mode_t allocation_mode = lt::storage_mode_sparse;
     bool enable_watch = true;
     lt::time_point next_dir_scan = lt::clock_type::now();
+    lt::time_point next_checkpoint = lt::clock_type::now() + lt::seconds(CHECKPOINT_INTERVAL);
+    lt::time_duration save_deadline = lt::seconds(S_SAVE_DEADLINE);
 
 
 #ifndef TORRENT_DISABLE_DHT
-    std::vector<lt::dht_lookup> dht_active_requests;
-    std::vector<lt::dht_routing_bucket> dht_routing_table;
+    // dht_stats_alert is only asked for while someone reads it
+    bool dht_enabled_ = false;
+    std::atomic_int64_t dht_watched_until_{0}; // seconds of lt::clock_type
+    mutable std::mutex dht_mutex_;
+    std::shared_ptr<std::string const> dht_snapshot_;
+    int dht_warm_nodes_ = 0;
+    std::atomic_int64_t dht_bootstrap_ms_{-1};
+    lt::time_point const started_ = lt::clock_type::now();
+    lt::time_point next_dht_save = lt::clock_type::now() + lt::seconds(DHT_CHECKPOINT);
 #endif
+    peer_view peers_;
+    // streams wait on these before sending fresh pieces from disk
+    mutable stream_pieces streamed_;
+    tracker_health trackers_;
+    // a single thread, so a restore never runs between a stash and its
+    // replace_trackers, and a sweep over every torrent stalls no ingest
+    boost::asio::thread_pool tracker_worker_{1};
+    lt::time_point next_peer_sweep = lt::clock_type::now();
+
+    // a checkpoint still queued must not overwrite the final save
+    std::mutex ses_state_mutex_;
+    std::uint64_t ses_state_gen_ = 0;
 
 
 }; // sheath
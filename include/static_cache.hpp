@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace btd {
+
+namespace fs = std::filesystem;
+
+// One file of the web UI, immutable once loaded
+struct static_asset
+{
+    std::shared_ptr<std::string const> raw;
+    std::shared_ptr<std::string const> gzip; // null when it does not pay
+    std::string etag;          // quoted, from size and crc32
+    std::string last_modified; // http-date
+    std::string_view mime;
+    fs::file_time_type mtime;
+};
+
+/** The web UI tree held in memory with precompressed variants
+
+    Loaded at startup and refreshed from the caller loop, a refresh
+    only reads the files whose size or mtime changed.
+*/
+class static_cache
+{
+    std::string const root_;
+    mutable std::shared_mutex mutex_;
+    // keyed by request path, "/index.html"
+    std::unordered_map<std::string, std::shared_ptr<static_asset const>> assets_;
+    std::chrono::steady_clock::time_point next_refresh_;
+    // the last refresh found no files, it was warned about once
+    bool missing_ = false;
+
+    std::shared_ptr<static_asset const>
+    load_file(fs::path const& file, std::string_view key) const;
+
+public:
+    explicit static_cache(std::string root);
+
+    // rescan the tree, at most every STATIC_REFRESH seconds unless forced
+    void
+    refresh(bool force = false);
+
+    // by request target without query, nullptr when absent or too big
+    std::shared_ptr<static_asset const>
+    find(std::string_view path);
+
+    std::size_t
+    size() const;
+};
+
+} // namespace btd
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <libtorrent/bitfield.hpp>
+#include <libtorrent/sha1_hash.hpp>
+
+namespace btd {
+
+/** Pieces of the torrents being streamed, kept from the alerts
+
+    A stream opens with the pieces its torrent had then, taken as on
+    disk; those finishing later come from piece_finished_alert. Such a
+    piece passed its hash check while still in the write cache, it is
+    sent once a flush asked after it is done. flush_cache releases the
+    files, a fence on the disk threads, so counting the flushes asked
+    and the cache_flushed_alerts is enough to tell.
+*/
+class stream_pieces
+{
+public:
+    enum class wait
+    {
+        none,
+        piece, // not downloaded yet
+        flush, // in the write cache
+    };
+
+    // off when the session runs without a write cache
+    std::atomic_bool write_cache{true};
+
+    // a stream of ih opens, nothing is fresh when seeding
+    void
+    open(lt::sha1_hash const& ih, lt::typed_bitfield const& have, int num_pieces, bool seeding);
+
+    void
+    close(lt::sha1_hash const& ih);
+
+    // from piece_finished_alert
+    void
+    finished(lt::sha1_hash const& ih, int piece);
+
+    // from cache_flushed_alert
+    void
+    flushed(lt::sha1_hash const& ih);
+
+    void
+    remove(lt::sha1_hash const& ih);
+
+    /* The end of the pieces from first, before end, that can be sent.
+       Short of end, why tells what the next one waits for; flush is set
+       once per flush to ask for, the caller then calls flush_cache.
+    */
+    int
+    ready(lt::sha1_hash const& ih, int first, int end, wait& why, bool& flush);
+
+    // no cache_flushed_alert came, take the flushes asked as done
+    void
+    expire_flush(lt::sha1_hash const& ih);
+
+private:
+    // per piece: missing, on_disk, or the flushes asked when it finished
+    static constexpr std::int64_t missing = -2;
+    static constexpr std::int64_t on_disk = -1;
+
+    struct entry
+    {
+        int streams = 0;
+        std::vector<std::int64_t> since;
+        std::int64_t asked = 0;
+        std::int64_t done = 0;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<lt::sha1_hash, entry> torrents_;
+};
+
+} // namespace btd
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "net.hpp"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace btd {
+
+// "0-3,8,10-11" into a sorted list of cpus, false when malformed
+bool
+parse_cpu_list(std::string_view s, std::vector<int>& cpus);
+
+json::array
+cpus_json(std::vector<int> const& cpus);
+
+// pin the calling thread, an empty list leaves it as it is
+bool
+pin_thread(std::vector<int> const& cpus);
+
+/** Pins the calling thread for a scope, then restores its affinity
+
+    Threads inherit the affinity of their creator, so pools and the
+    libtorrent threads are pinned by constructing them inside one.
+*/
+class scoped_affinity
+{
+#ifdef __linux__
+    cpu_set_t prev_;
+#endif
+    bool set_ = false;
+
+public:
+    explicit scoped_affinity(std::vector<int> const& cpus);
+    ~scoped_affinity();
+
+    scoped_affinity(scoped_affinity const&) = delete;
+    scoped_affinity& operator=(scoped_affinity const&) = delete;
+};
+
+// Load of a thread pool
+struct pool_stats
+{
+    int const threads;
+    std::chrono::steady_clock::time_point const started = std::chrono::steady_clock::now();
+
+    std::atomic_int64_t queued{0};
+    std::atomic_int64_t running{0};
+    std::atomic_int64_t tasks{0};
+    std::atomic_int64_t busy_us{0};
+
+    explicit pool_stats(int threads)
+        : threads(threads)
+    {}
+
+    json::value
+    to_json() const;
+};
+
+// post f to ex, counted in st which must outlive the task
+template<class Executor, class Function>
+void
+tracked_post(Executor& ex, pool_stats& st, Function&& f)
+{
+    ++st.queued;
+    boost::asio::post(ex, [&st, f = std::forward<Function>(f)]() mutable
+    {
+        --st.queued;
+        ++st.running;
+        auto const t0 = std::chrono::steady_clock::now();
+        f();
+        st.busy_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        --st.running;
+        ++st.tasks;
+    });
+}
+
+// Lag of an io_context, how late a timer runs behind its deadline
+struct loop_stats
+{
+    int threads = 0;
+    std::atomic_int64_t lag_us{0};     // last probe
+    std::atomic_int64_t max_lag_us{0}; // since start
+    std::atomic_int64_t probes{0};
+
+    json::value
+    to_json() const;
+};
+
+class loop_probe : public std::enable_shared_from_this<loop_probe>
+{
+    net::steady_timer timer_;
+    loop_stats& stats_;
+
+    void
+    arm();
+
+public:
+    loop_probe(net::io_context& ioc, loop_stats& stats)
+        : timer_(ioc)
+        , stats_(stats)
+    {}
+
+    void
+    run()
+    {
+        arm();
+    }
+};
+
+} // namespace btd
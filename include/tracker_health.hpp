@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/json/value.hpp>
+#include <libtorrent/add_torrent_params.hpp>
+#include <libtorrent/announce_entry.hpp>
+#include <libtorrent/sha1_hash.hpp>
+#include <libtorrent/time.hpp>
+
+namespace btd {
+
+namespace json = boost::json;
+
+// lowercase host of a tracker url, without user or port
+std::string
+tracker_host(std::string_view url);
+
+/** Announce and scrape results of every tracker url, from its alerts
+
+    Failures are also counted per host, across all torrents. A host
+    that only failed for TRACKER_FAIL_LIMIT announces in a row over at
+    least TRACKER_FAIL_WINDOW seconds is suppressed: the session takes
+    its trackers out of every torrent and stashes them here until the
+    backoff passes, starting at TRACKER_BACKOFF_MIN and doubling up to
+    TRACKER_BACKOFF_MAX while the host keeps failing after its return.
+*/
+class tracker_health
+{
+public:
+    enum class verdict
+    {
+        ok,
+        dead,       // the host is suppressed from now on
+        suppressed, // it already was, this torrent still had it
+    };
+
+    // off with --tracker-suppress=false, only the stats are kept
+    std::atomic_bool suppress{true};
+
+    void
+    announced(lt::sha1_hash const& ih, std::string const& url, lt::time_point t);
+
+    void
+    replied(lt::sha1_hash const& ih, std::string const& url, int peers, lt::time_point t);
+
+    // reachable when the tracker answered, only refusing the torrent
+    verdict
+    failed(lt::sha1_hash const& ih, std::string const& url, bool reachable, std::string message);
+
+    void
+    scraped(std::string const& url, int complete, int incomplete);
+
+    void
+    scrape_failed(std::string const& url, std::string message);
+
+    // keep the trackers of host taken out of a torrent
+    void
+    stash(lt::sha1_hash const& ih, std::string const& host, std::vector<lt::announce_entry> entries);
+
+    // hosts whose suppression ran out, to give their trackers back
+    std::vector<std::string>
+    expired(std::time_t now);
+
+    // the stashed trackers of hosts, per torrent
+    std::vector<std::pair<lt::sha1_hash, std::vector<lt::announce_entry>>>
+    stashed(std::vector<std::string> const& hosts) const;
+
+    void
+    unstash(std::vector<std::string> const& hosts);
+
+    // put the stashed trackers of a torrent back into its resume data
+    void
+    restore_into(lt::add_torrent_params& atp) const;
+
+    void
+    remove(lt::sha1_hash const& ih);
+
+    // hosts suppressed now
+    int
+    num_suppressed() const;
+
+    std::int64_t
+    num_suppressions() const noexcept
+    {
+        return suppressions_.load();
+    }
+
+    json::value
+    to_json(int queued_announces) const;
+
+private:
+    struct url_stats
+    {
+        std::string host;
+        std::int64_t announces = 0;
+        std::int64_t replies = 0;
+        std::int64_t errors = 0;
+        int fails_in_row = 0;
+        std::int64_t latency_ms = 0; // sum over the replies
+        int peers = 0;               // in the last reply
+        std::time_t last_reply = 0;
+        std::time_t last_error = 0;
+        std::string message;
+        std::int64_t scrapes = 0;
+        std::int64_t scrape_errors = 0;
+        int complete = -1;
+        int incomplete = -1;
+    };
+
+    struct host_state
+    {
+        int fails_in_row = 0;
+        std::time_t fail_since = 0;
+        std::time_t suppressed_until = 0;
+        int backoff = 0; // seconds of the last suppression
+        int suppressions = 0;
+    };
+
+    // null past TRACKERS_MAX urls
+    url_stats*
+    find(std::string const& url);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, url_stats> urls_;
+    std::unordered_map<std::string, host_state> hosts_;
+    // announces waiting for an answer, by info hash and url
+    std::unordered_map<std::string, lt::time_point> pending_;
+    std::unordered_map<lt::sha1_hash, std::vector<std::pair<std::string, lt::announce_entry>>> stash_;
+    std::int64_t dropped_ = 0;
+    std::atomic_int64_t suppressions_{0};
+};
+
+} // namespace btd
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include <boost/beast/core/buffer_traits.hpp>
+#include <boost/beast/core/buffers_range.hpp>
+#include <boost/beast/http/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+
+#include "net.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+/** A string body that grows as the bytes arrive
+
+    Unlike string_body, it does not reserve the whole Content-Length
+    before reading, only up to UPLOAD_RESERVE_MAX of it, so a client
+    declaring a large body it never sends holds little memory.
+*/
+struct upload_body
+{
+    using value_type = std::string;
+
+    static std::uint64_t
+    size(value_type const& body) noexcept
+    {
+        return body.size();
+    }
+
+    class reader
+    {
+        value_type& body_;
+
+    public:
+        template<bool isRequest, class Fields>
+        reader(http::header<isRequest, Fields>&, value_type& body)
+            : body_(body)
+        {
+        }
+
+        void
+        init(boost::optional<std::uint64_t> const& length, beast::error_code& ec)
+        {
+            if (length && *length > body_.max_size())
+            {
+                ec = http::error::buffer_overflow;
+                return;
+            }
+            if (length) body_.reserve(std::size_t(std::min<std::uint64_t>(*length, UPLOAD_RESERVE_MAX)));
+            ec = {};
+        }
+
+        template<class ConstBufferSequence>
+        std::size_t
+        put(ConstBufferSequence const& buffers, beast::error_code& ec)
+        {
+            auto const extra = beast::buffer_bytes(buffers);
+            auto const size = body_.size();
+            if (extra > body_.max_size() - size)
+            {
+                ec = http::error::buffer_overflow;
+                return 0;
+            }
+            // append grows the capacity geometrically past the reserve
+            for (auto const b : beast::buffers_range_ref(buffers))
+                body_.append(static_cast<char const*>(b.data()), b.size());
+            ec = {};
+            return extra;
+        }
+
+        void
+        finish(beast::error_code& ec)
+        {
+            ec = {};
+        }
+    };
+};
+
+} // namespace btd
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+namespace btd {
+
+/** Request body buffers kept between large uploads
+
+    A body over the default limit is read into a buffer taken from here,
+    reserved to its Content-Length up to UPLOAD_RESERVE_MAX, and given
+    back once the request was handled, so steady uploads stop hitting
+    the allocator.
+*/
+class upload_pool
+{
+    std::mutex mutex_;
+    std::vector<std::string> free_;
+
+public:
+    std::atomic_int64_t uploads{0};
+    std::atomic_int64_t bytes{0};
+    std::atomic_int64_t max_bytes{0};
+    std::atomic_int64_t rejected{0}; // over the route limit
+    std::atomic_int64_t parsed{0};
+    std::atomic_int64_t parse_us{0};
+    std::atomic_int64_t reused{0};
+
+    // an empty buffer with size bytes, at most UPLOAD_RESERVE_MAX, reserved
+    std::string
+    acquire(std::size_t size);
+
+    // take back a body after its request was handled
+    void
+    release(std::string&& buf, std::size_t received);
+
+    void
+    record_parse(std::uint64_t us) noexcept
+    {
+        ++parsed;
+        parse_us += std::int64_t(us);
+    }
+
+    json::value
+    to_json();
+};
+
+} // namespace btd
@@ -27,10 +27,64 @@ namespace fs = std::filesystem;
 const std::string SESS_FILE  = ".ses_state"s;
 const std::string RESUME_DIR = ".resume"s;
 const std::string RESUME_EXT = ".resume"s;
+const std::string META_DIR   = ".metadata"s;
+const std::string META_EXT   = ".torrent"s;
 const std::string WATCH_DIR  = "watching"s;
 const std::string CERT_DIR   = "certificates"s;
 const int WATCH_INTERVAL     = 2; // seconds
-const int S_WAIT_SAVE        = 6; // seconds
+const int WATCH_FALLBACK     = 60; // seconds, polling while inotify is active
+const int PARSE_WORKERS      = 2; // threads parsing ingested .torrent files
+const int INGEST_BATCH       = 64; // torrents submitted to the session at once
+const int INGEST_JOBS_KEEP   = 32; // finished bulk jobs kept for polling
+const int STREAM_CHUNK       = 1024 * 1024; // bytes per content send
+const int STREAM_READAHEAD   = 8;   // pieces with a deadline ahead of a stream
+const int STREAM_DEADLINE_STEP = 500; // ms between read-ahead piece deadlines
+const int STREAM_POLL_MS     = 200; // ms between checks of a stalled stream
+const int STREAM_STALL_TIMEOUT = 60; // seconds without data before giving up
+const int STREAM_FLUSH_POLL_MS = 20; // ms between checks for a confirmed cache flush
+const int STREAM_FLUSH_WAIT_MS = 5000; // ms to wait for a cache_flushed_alert before sending anyway
+const int STATIC_REFRESH     = 5; // seconds between web UI rescans
+const std::size_t STATIC_MAX_FILE = 8 * 1024 * 1024; // larger UI files are read per request
+const std::size_t STATIC_GZIP_MIN = 256; // bytes, smaller ones are sent as is
+const std::size_t REQUEST_BODY_MAX = 1024 * 1024; // bytes, default limit of a request body
+const std::size_t TORRENT_UPLOAD_MAX = 64 * 1024 * 1024; // bytes, POST /api/torrents
+const std::size_t BULK_UPLOAD_MAX = 256 * 1024 * 1024; // bytes, POST /api/torrents/bulk
+const std::size_t UPLOAD_POOL_KEEP = 4; // idle upload buffers kept
+const std::size_t UPLOAD_POOL_MAX_BUF = 64 * 1024 * 1024; // bigger buffers are freed
+const std::size_t UPLOAD_RESERVE_MAX = 1024 * 1024; // bytes of a declared body reserved before it arrives
+const int LOOP_PROBE_MS      = 1000; // ms between lag probes of the I/O loop
+const int QUERY_WORKERS      = 4; // threads running API handlers that block on the session
+const int QUERY_QUEUE_MAX    = 256; // queued or running API queries before 503
+const int QUERY_TIMEOUT      = 15; // seconds before an API query answers 504
+const int COMPRESS_LEVEL     = 6; // zlib level of API responses
+const std::size_t COMPRESS_MIN = 16 * 1024; // bytes, smaller API responses go out as is
+const int COMPRESS_WORKERS   = 2; // threads compressing API responses
+const int TORRENT_HISTORY_STEP = 60; // seconds per sample of a torrent's history
+const int TORRENT_HISTORY_SLOTS = 60; // samples kept per torrent
+const std::size_t TORRENT_HISTORY_MAX = 100000; // torrents with a history, ~50MB
+const int TORRENT_SPARK_POINTS = 15; // samples in the sparklines of /api/torrents?spark=1
+const int PIECES_CACHE_TTL   = 2; // seconds a rendered piece map serves, as availability drifts
+const std::size_t PIECES_CACHE_MAX = 256; // torrents with a cached piece map
+const int FILES_PAGE_LIMIT   = 1000; // files per page of /files by default
+const int FILES_PAGE_MAX     = 10000; // largest page of /files
+const std::size_t FILES_CACHE_MAX = 16; // torrents with a cached file table
+const int PEERS_SWEEP_INTERVAL = 5; // seconds between sweeps of connected peers
+const int PEERS_SWEEP_TORRENTS = 200; // torrents asked for their peers per sweep
+const int PEERS_TOP_N        = 20; // entries in each top list of /api/peers
+const int PEERS_WATCH_TTL    = 60; // seconds of peer sweeps after a read of /api/peers
+const std::size_t TRACKERS_MAX = 4096; // tracker urls with stats
+const std::size_t TRACKER_PENDING_MAX = 100000; // announces timed for latency
+const int TRACKER_PENDING_TTL = 120; // seconds an unanswered announce is still timed
+const int TRACKER_FAIL_LIMIT = 20; // failures in a row, of all torrents, before a host is suppressed
+const int TRACKER_FAIL_WINDOW = 120; // seconds those failures must span at least
+const int TRACKER_BACKOFF_MIN = 600; // seconds of the first suppression of a host
+const int TRACKER_BACKOFF_MAX = 6 * 3600; // longest suppression, doubling from the min
+const int DHT_CHECKPOINT     = 300; // seconds between saves of the dht routing table
+const int DHT_WATCH_TTL      = 10; // seconds of dht stats polling after a read of /api/dht
+const int S_SAVE_DEADLINE    = 30; // seconds, final resume flush
+const int CHECKPOINT_INTERVAL = 5; // seconds
+const int CHECKPOINT_BATCH   = 64; // resume saves per checkpoint tick
+const int RESUME_WRITERS     = 4; // threads writing resume files
 const int PERCENT_ONE        = 10000;
 const int PERCENT_DONE       = 100 * PERCENT_ONE;
 
@@ -50,7 +104,11 @@ std::string const
 path_cat(std::string_view const& base, std::string_view const& path);
 
 bool
-from_hex(lt::sha1_hash & ih, std::string const &s);
+from_hex(lt::sha1_hash & ih, std::string_view s);
+
+// 40 hex digits or 32 base32 ones, as in magnet links
+bool
+parse_info_hash(lt::sha1_hash & ih, std::string_view s);
 
 std::string
 to_hex(lt::sha1_hash const& s);
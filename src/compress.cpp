@@ -0,0 +1,144 @@
+
+#include <cctype>
+#include <ctime>
+
+#include <zlib.h>
+
+#include "compress.hpp"
+
+namespace btd {
+
+bool
+compress(std::string_view in, std::string& out, coding c, int level)
+{
+    if (c == coding::identity) return false;
+
+    z_stream zs{};
+    // 15 window bits, +16 wraps the stream in a gzip header
+    int const bits = c == coding::gzip ? 15 + 16 : 15;
+    if (deflateInit2(&zs, level, Z_DEFLATED, bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    out.resize(deflateBound(&zs, uLong(in.size())));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = uInt(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = uInt(out.size());
+
+    int const ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+char const*
+coding_name(coding c) noexcept
+{
+    switch (c) {
+    case coding::gzip: return "gzip";
+    case coding::deflate: return "deflate";
+    case coding::identity: return "identity";
+    }
+    return "identity";
+}
+
+namespace {
+
+bool
+iequals(std::string_view a, std::string_view b) noexcept
+{
+    if (a.size() != b.size()) return false;
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(a[i]))
+            != std::tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    }
+    return true;
+}
+
+std::string_view
+trim(std::string_view s) noexcept
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+} // namespace
+
+coding
+accepted_coding(std::string_view accept_encoding) noexcept
+{
+    bool gzip = false;
+    bool deflate = false;
+    while (!accept_encoding.empty())
+    {
+        auto const comma = accept_encoding.find(',');
+        auto item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos
+            ? std::string_view{} : accept_encoding.substr(comma + 1);
+
+        auto const semi = item.find(';');
+        auto const name = trim(item.substr(0, semi));
+        // q=0 means "not acceptable"
+        if (semi != std::string_view::npos)
+        {
+            auto q = trim(item.substr(semi + 1));
+            if (q.starts_with("q=0") && q.find_first_not_of("0.", 2) == std::string_view::npos)
+                continue;
+        }
+        if (iequals(name, "gzip") || name == "*") gzip = true;
+        else if (iequals(name, "deflate")) deflate = true;
+    }
+    if (gzip) return coding::gzip;
+    if (deflate) return coding::deflate;
+    return coding::identity;
+}
+
+bool
+compressible(std::string_view mime) noexcept
+{
+    return mime.starts_with("text/")
+        || mime == "application/javascript"
+        || mime == "application/json"
+        || mime == "application/text"
+        || mime == "image/svg+xml"
+        || mime == "image/vnd.microsoft.icon";
+}
+
+std::uint64_t
+thread_cpu_us() noexcept
+{
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return std::uint64_t(ts.tv_sec) * 1000000 + std::uint64_t(ts.tv_nsec) / 1000;
+}
+
+void
+compress_stats::
+record(std::size_t in, std::size_t out, std::uint64_t us) noexcept
+{
+    ++responses;
+    bytes_in += std::int64_t(in);
+    bytes_out += std::int64_t(out);
+    cpu_us += std::int64_t(us);
+}
+
+json::value
+compress_stats::
+to_json() const
+{
+    auto const in = bytes_in.load();
+    auto const out = bytes_out.load();
+    return json::value({
+         {"responses", responses.load()}
+        ,{"skipped", skipped.load()}
+        ,{"bytesIn", in}
+        ,{"bytesOut", out}
+        ,{"ratio", in > 0 ? double(out) / double(in) : 1.0}
+        ,{"cpuUs", cpu_us.load()}
+    });
+}
+
+} // namespace btd
@@ -0,0 +1,337 @@
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/write.hpp>
+
+#include "content_stream.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+using namespace std::chrono;
+
+std::uint64_t
+stream_registry::
+add(std::weak_ptr<content_stream> cs)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.emplace(++last_id_, std::move(cs));
+    ++streams;
+    return last_id_;
+}
+
+void
+stream_registry::
+remove(std::uint64_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.erase(id);
+}
+
+json::value
+stream_registry::
+to_json() const
+{
+    json::array arr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const& [id, wp] : active_)
+        {
+            if (auto cs = wp.lock())
+            {
+                auto obj = cs->to_json();
+                obj.emplace("id", id);
+                arr.emplace_back(std::move(obj));
+            }
+        }
+    }
+    return json::value({
+         {"active", std::move(arr)}
+        ,{"streams", streams.load()}
+        ,{"bytes", bytes.load()}
+        ,{"stalls", stalls.load()}
+        ,{"stallMs", stall_ms.load()}
+        ,{"aborted", aborted.load()}
+    });
+}
+
+//------------------------------------------------------------------------------
+
+content_stream::
+content_stream(
+    http_stream& stream,
+    content_plan plan,
+    std::int64_t first,
+    std::int64_t last,
+    http::response<http::empty_body> header,
+    stream_registry& registry)
+    : stream_(stream)
+    , plan_(std::move(plan))
+    , ih_(plan_.th.info_hash())
+    , first_(first)
+    , last_(last)
+    , pos_(first)
+    , have_end_(plan_.file_offset + first)
+    , res_(std::move(header))
+    , timer_(stream.get_executor())
+    , registry_(registry)
+{
+    plan_.pieces->open(ih_, plan_.have, plan_.num_pieces, plan_.seeding);
+}
+
+content_stream::
+~content_stream()
+{
+    if (fd_ >= 0) ::close(fd_);
+    plan_.pieces->close(ih_);
+}
+
+void
+content_stream::
+run(bool head_only, done_handler done)
+{
+    done_ = std::move(done);
+    id_ = registry_.add(weak_from_this());
+    started_ = steady_clock::now();
+
+    // the stall timer replaces the stream timeout while sending
+    stream_.expires_never();
+
+    sr_.emplace(res_);
+    http::async_write_header(stream_, *sr_,
+        [self = shared_from_this(), head_only](beast::error_code ec, std::size_t)
+        {
+            if (ec || head_only) return self->finish(ec);
+            self->set_deadlines();
+            self->send_some();
+        });
+}
+
+json::object
+content_stream::
+to_json() const
+{
+    auto const elapsed = duration_cast<milliseconds>(steady_clock::now() - started_).count();
+    auto const sent = sent_.load();
+    return json::object({
+         {"info_hash", to_hex(plan_.th.info_hash())}
+        ,{"path", plan_.path}
+        ,{"first", first_}
+        ,{"last", last_}
+        ,{"sent", sent}
+        ,{"elapsedMs", elapsed}
+        ,{"rate", elapsed > 0 ? sent * 1000 / elapsed : 0}
+        ,{"stalls", stalls_.load()}
+        ,{"stallMs", stall_ms_.load()}
+    });
+}
+
+// contiguous bytes from pos_ that are on disk, at most STREAM_CHUNK
+std::int64_t
+content_stream::
+available()
+{
+    auto const abs = plan_.file_offset + pos_;
+    auto const want = std::min(plan_.file_offset + last_ + 1, abs + STREAM_CHUNK);
+    if (have_end_ < want)
+    {
+        int const first = int(have_end_ / plan_.piece_length);
+        int const end = int((want - 1) / plan_.piece_length) + 1;
+        bool flush = false;
+        int const ready = plan_.pieces->ready(ih_, first, end, waiting_, flush);
+        if (flush) plan_.th.flush_cache();
+        if (ready > first) have_end_ = std::int64_t(ready) * plan_.piece_length;
+    }
+    return std::max<std::int64_t>(0, std::min(have_end_, want) - abs);
+}
+
+// give the pieces under the read-ahead window rising deadlines
+void
+content_stream::
+set_deadlines()
+{
+    int const cur = int((plan_.file_offset + pos_) / plan_.piece_length);
+    int const end = int((plan_.file_offset + last_) / plan_.piece_length);
+    int const upto = std::min(end, cur + STREAM_READAHEAD - 1);
+    for (int p = std::max(cur, deadline_upto_ + 1); p <= upto; ++p)
+    {
+        plan_.th.set_piece_deadline(lt::piece_index_t(p), (p - cur) * STREAM_DEADLINE_STEP);
+    }
+    deadline_upto_ = std::max(deadline_upto_, upto);
+}
+
+bool
+content_stream::
+open_file()
+{
+    if (fd_ >= 0) return true;
+    fd_ = ::open(plan_.path.c_str(), O_RDONLY | O_CLOEXEC);
+    return fd_ >= 0;
+}
+
+void
+content_stream::
+send_some()
+{
+    if (pos_ > last_) return finish({});
+
+    auto const n = available();
+    if (n == 0) return waiting_ == stream_pieces::wait::flush ? wait_flush() : wait_pieces();
+    flushing_ = false;
+
+    if (stalled_)
+    {
+        stalled_ = false;
+        auto const ms = duration_cast<milliseconds>(steady_clock::now() - stall_start_).count();
+        stall_ms_ += ms;
+        registry_.stall_ms += ms;
+    }
+
+    if (!open_file())
+        return finish(beast::error_code(errno, boost::system::system_category()));
+
+#ifdef __linux__
+    auto& sock = stream_.socket();
+    beast::error_code ec;
+    sock.native_non_blocking(true, ec);
+    if (ec) return finish(ec);
+
+    off_t off = off_t(pos_);
+    auto const r = ::sendfile(sock.native_handle(), fd_, &off, std::size_t(n));
+    if (r < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            sock.async_wait(stream_protocol::socket::wait_write,
+                [self = shared_from_this()](beast::error_code ec)
+                {
+                    if (ec) return self->finish(ec);
+                    self->send_some();
+                });
+            return;
+        }
+        if (errno == EINTR) return on_sent(0);
+        return finish(beast::error_code(errno, boost::system::system_category()));
+    }
+    // the file is shorter than the pieces claim, it is being moved or allocated
+    if (r == 0) return wait_pieces();
+    on_sent(std::size_t(r));
+#else
+    auto const want = std::min<std::int64_t>(n, std::int64_t(buf_.size()));
+    auto const r = ::pread(fd_, buf_.data(), std::size_t(want), off_t(pos_));
+    if (r < 0) return finish(beast::error_code(errno, boost::system::system_category()));
+    if (r == 0) return wait_pieces();
+    net::async_write(stream_, net::buffer(buf_.data(), std::size_t(r)),
+        [self = shared_from_this()](beast::error_code ec, std::size_t n)
+        {
+            if (ec) return self->finish(ec);
+            self->on_sent(n);
+        });
+#endif
+}
+
+void
+content_stream::
+on_sent(std::size_t n)
+{
+    int const before = int((plan_.file_offset + pos_) / plan_.piece_length);
+    pos_ += std::int64_t(n);
+    sent_ += std::int64_t(n);
+    registry_.bytes += std::int64_t(n);
+    if (int((plan_.file_offset + pos_) / plan_.piece_length) != before) set_deadlines();
+
+    // let other handlers on this strand run between chunks
+    net::post(stream_.get_executor(),
+        [self = shared_from_this()]
+        {
+            self->send_some();
+        });
+}
+
+void
+content_stream::
+wait_pieces()
+{
+    auto const now = steady_clock::now();
+    if (!stalled_)
+    {
+        stalled_ = true;
+        stall_start_ = now;
+        ++stalls_;
+        ++registry_.stalls;
+    }
+    else if (now - stall_start_ > seconds(STREAM_STALL_TIMEOUT))
+    {
+        LOG_WARNING << "stream stalled, give up " << plan_.path << " at " << pos_;
+        return finish(beast::error::timeout);
+    }
+
+    set_deadlines();
+    timer_.expires_after(milliseconds(STREAM_POLL_MS));
+    timer_.async_wait([self = shared_from_this()](beast::error_code ec)
+    {
+        if (ec) return self->finish(ec);
+        self->send_some();
+    });
+}
+
+// the next piece is in the write cache, a flush of it was asked for
+void
+content_stream::
+wait_flush()
+{
+    auto const now = steady_clock::now();
+    if (!flushing_)
+    {
+        flushing_ = true;
+        flush_start_ = now;
+    }
+    else if (now - flush_start_ > milliseconds(STREAM_FLUSH_WAIT_MS))
+    {
+        LOG_WARNING << "no cache flush confirmed, send anyway " << plan_.path;
+        plan_.pieces->expire_flush(ih_);
+        flushing_ = false;
+        return send_some();
+    }
+
+    timer_.expires_after(milliseconds(STREAM_FLUSH_POLL_MS));
+    timer_.async_wait([self = shared_from_this()](beast::error_code ec)
+    {
+        if (ec) return self->finish(ec);
+        self->send_some();
+    });
+}
+
+void
+content_stream::
+finish(beast::error_code ec)
+{
+    registry_.remove(id_);
+    if (pos_ <= last_)
+    {
+        // nobody waits for the rest of the window any more
+        int const cur = int((plan_.file_offset + pos_) / plan_.piece_length);
+        for (int p = cur; p <= deadline_upto_; ++p)
+            plan_.th.reset_piece_deadline(lt::piece_index_t(p));
+        if (ec) ++registry_.aborted;
+    }
+    stream_.expires_after(std::chrono::seconds(30));
+    if (done_)
+    {
+        auto done = std::move(done_);
+        done_ = nullptr;
+        done(ec, ec || res_.need_eof());
+    }
+}
+
+} // namespace btd
@@ -0,0 +1,149 @@
+
+#include <cerrno>
+#include <cstring>
+
+#include <boost/beast/core/bind_handler.hpp>
+
+#include "dir_watcher.hpp"
+#include "log.hpp"
+
+namespace btd {
+
+#ifdef __linux__
+
+dir_watcher::
+dir_watcher(
+    net::io_context& ioc,
+    std::shared_ptr<sheath> const& shth)
+    : shth_(shth)
+    , desc_(ioc)
+{
+}
+
+bool
+dir_watcher::
+run()
+{
+    int const fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_WARNING << "inotify unavailable: " << std::strerror(errno) << ", polling only";
+        return false;
+    }
+    desc_.assign(fd);
+
+    for (auto const& w : shth_->watch_dirs())
+    {
+        int const wd = ::inotify_add_watch(fd, w.dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            LOG_WARNING << "failed to watch " << w.dir << ": " << std::strerror(errno);
+            continue;
+        }
+        LOG_INFO << "inotify on " << w.dir;
+        wds_.emplace(wd, w);
+    }
+
+    if (wds_.empty())
+    {
+        beast::error_code ec;
+        desc_.close(ec);
+        return false;
+    }
+
+    shth_->set_watching(true);
+    do_read();
+    return true;
+}
+
+void
+dir_watcher::
+do_read()
+{
+    desc_.async_read_some(
+        net::buffer(buf_),
+        beast::bind_front_handler(
+            &dir_watcher::on_read,
+            shared_from_this()));
+}
+
+void
+dir_watcher::
+on_read(beast::error_code ec, std::size_t bytes)
+{
+    if (ec)
+    {
+        // hand everything back to the polling scan
+        shth_->set_watching(false);
+        if (ec != net::error::operation_aborted)
+            LOG_WARNING << "inotify read: " << ec.message();
+        return;
+    }
+
+    for (std::size_t i = 0; i + sizeof(inotify_event) <= bytes;)
+    {
+        auto const* ev = reinterpret_cast<inotify_event const*>(buf_.data() + i);
+        i += sizeof(inotify_event) + ev->len;
+
+        // the kernel dropped events, let the scan pick up the rest
+        if (ev->mask & IN_Q_OVERFLOW)
+        {
+            shth_->rescan();
+            continue;
+        }
+
+        auto const it = wds_.find(ev->wd);
+        if (it == wds_.end()) continue;
+        if (ev->mask & IN_IGNORED)
+        {
+            LOG_WARNING << "watch directory gone: " << it->second.dir;
+            wds_.erase(it);
+            continue;
+        }
+        if (ev->len == 0) continue;
+
+        auto const file = it->second.dir / ev->name;
+        if (file.extension() != ".torrent") continue;
+        shth_->ingest_file(file.string(), it->second.save_path);
+    }
+
+    if (wds_.empty())
+    {
+        shth_->set_watching(false);
+        return;
+    }
+    do_read();
+}
+
+#else
+
+dir_watcher::
+dir_watcher(
+    net::io_context&,
+    std::shared_ptr<sheath> const& shth)
+    : shth_(shth)
+{
+}
+
+bool
+dir_watcher::
+run()
+{
+    return false;
+}
+
+void
+dir_watcher::
+do_read()
+{
+}
+
+void
+dir_watcher::
+on_read(beast::error_code, std::size_t)
+{
+}
+
+#endif
+
+} // namespace btd
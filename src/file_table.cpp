@@ -0,0 +1,119 @@
+
+#include <algorithm>
+
+#include <boost/json/serialize.hpp>
+#include <boost/json/value.hpp>
+namespace json = boost::json;
+
+#include "file_table.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+file_table::
+file_table(std::shared_ptr<lt::torrent_info const> ti, std::vector<std::int64_t> const& progress)
+    : ti_(std::move(ti))
+{
+    auto const& fs = ti_->files();
+    auto const n = std::size_t(fs.num_files());
+    entries_.reserve(n);
+    sizes_.reserve(n);
+    complete_ = std::make_unique<std::atomic_bool[]>(n);
+    dirs_[""];
+
+    for (lt::file_index_t i(0); i < fs.end_file(); ++i)
+    {
+        auto const idx = std::size_t(static_cast<int>(i));
+        auto const path = fs.file_path(i);
+        auto const size = fs.file_size(i);
+        sizes_.push_back(size);
+        complete_[idx] = idx < progress.size() && progress[idx] == size;
+
+        std::string e = "\"name\":";
+        e.append(json::serialize(json::value(fs.file_name(i).to_string())));
+        e.append(",\"path\":");
+        e.append(json::serialize(json::value(path)));
+        e.append(",\"size\":");
+        e.append(std::to_string(size));
+        entries_.push_back(std::move(e));
+
+        // every directory above the file, from the root down
+        std::string_view const p(path);
+        std::size_t slash = 0;
+        std::string parent;
+        for (;;)
+        {
+            auto& d = dirs_[parent];
+            d.size += size;
+            ++d.count;
+            auto const next = p.find('/', slash);
+            if (next == std::string_view::npos)
+            {
+                d.files.push_back(int(idx));
+                break;
+            }
+            std::string child(p.substr(0, next));
+            if (dirs_.find(child) == dirs_.end())
+            {
+                d.dirs.emplace_back(p.substr(slash, next - slash));
+                dirs_[child];
+            }
+            parent = std::move(child);
+            slash = next + 1;
+        }
+    }
+}
+
+file_table::dir const*
+file_table::
+find_dir(std::string_view path) const
+{
+    while (!path.empty() && path.back() == '/') path.remove_suffix(1);
+    auto const it = dirs_.find(std::string(path));
+    return it == dirs_.end() ? nullptr : &it->second;
+}
+
+std::shared_ptr<file_table>
+file_cache::
+find(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = tables_.find(ih);
+    if (it == tables_.end()) return {};
+    it->second.second = ++tick_;
+    return it->second.first;
+}
+
+void
+file_cache::
+store(lt::sha1_hash const& ih, std::shared_ptr<file_table> table)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tables_.size() >= FILES_CACHE_MAX && tables_.find(ih) == tables_.end())
+    {
+        // the one listed longest ago
+        auto const lru = std::min_element(tables_.begin(), tables_.end(),
+            [](auto const& a, auto const& b) { return a.second.second < b.second.second; });
+        tables_.erase(lru);
+    }
+    tables_[ih] = {std::move(table), ++tick_};
+}
+
+void
+file_cache::
+file_completed(lt::sha1_hash const& ih, int index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = tables_.find(ih);
+    if (it != tables_.end()) it->second.first->set_complete(index);
+}
+
+void
+file_cache::
+remove(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tables_.erase(ih);
+}
+
+} // namespace btd
@@ -1,17 +1,22 @@
 
 
+#include <charconv>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string_view>
 #include <unordered_set>
 
+#include <boost/asio/post.hpp>
 #include <boost/json/value.hpp>
 namespace json = boost::json;
 #include "json_diff.hpp"
+#include <boost/json/parse.hpp>
 #include <boost/json/serialize.hpp>
 
 #include <libtorrent/config.hpp>
+#include <libtorrent/torrent_info.hpp>
 
 #include "handlers.hpp"
 #include "http_websocket.hpp"
@@ -21,35 +26,155 @@ namespace btd {
 
 httpCaller::
 httpCaller(std::shared_ptr<sheath> const& shth,
-	std::string ui_dir)
+	std::string ui_dir, int query_threads)
 	 : shth_(shth)
 	 , ui_root_(ui_dir)
-{}
+	 , assets_(ui_root_)
+	 , query_pool_(query_threads)
+	 , queries_(query_threads)
+{
+	make_routes();
+}
+
 
+void
+httpCaller::
+make_routes()
+{
+    // routes run on the query pool unless they only read our own state
+    auto const add = [this](verb method, std::string_view pattern, auto fn
+        , std::size_t body_limit = REQUEST_BODY_MAX, bool offload = true)
+    {
+        routes_.add(method, pattern, route{
+            [this, fn](http::request<string_body> const& req, route_params const& rp)
+            {
+                return fn(this, req, rp);
+            }, body_limit, offload});
+    };
+    using req_t = http::request<string_body> const&;
+    using rp_t = route_params const&;
+
+    add(verb::get, "/session", [](auto self, req_t req, rp_t) { return self->handleSessionInfo(req); });
+    add(verb::get, "/session/stats", [](auto self, req_t req, rp_t) { return self->handleSessionStats(req); });
+    add(verb::get, "/session/history", [](auto self, req_t req, rp_t) { return self->handleSessionHistory(req); }
+        , REQUEST_BODY_MAX, false);
+    add(verb::put, "/session/toggle", [](auto self, req_t req, rp_t) { return self->handleSessionToggle(req); });
+    add(verb::get, "/sync/stats", [](auto self, req_t req, rp_t) { return self->handleSyncStats(req); });
+    add(verb::get, "/dht", [](auto self, req_t req, rp_t) { return self->handleDht(req); }
+        , REQUEST_BODY_MAX, false);
+    add(verb::get, "/peers", [](auto self, req_t req, rp_t) { return self->handlePeers(req); }
+        , REQUEST_BODY_MAX, false);
+    add(verb::get, "/trackers", [](auto self, req_t req, rp_t) { return self->handleTrackers(req); });
+    add(verb::get, "/streams", [](auto self, req_t req, rp_t) { return self->handleStreams(req); }
+        , REQUEST_BODY_MAX, false);
+    add(verb::get, "/server/stats", [](auto self, req_t req, rp_t) { return self->handleServerStats(req); }
+        , REQUEST_BODY_MAX, false);
+
+    add(verb::get, "/torrents", [](auto self, req_t req, rp_t) { return self->handleTorrents(req); });
+    add(verb::post, "/torrents", [](auto self, req_t req, rp_t) { return self->handleTorrents(req); }
+        , TORRENT_UPLOAD_MAX);
+    add(verb::post, "/torrents/batch", [](auto self, req_t req, rp_t) { return self->handleBatch(req); });
+    add(verb::post, "/torrents/bulk", [](auto self, req_t req, rp_t) { return self->handleBulk(req, {}); }
+        , BULK_UPLOAD_MAX);
+    add(verb::get, "/torrents/bulk/{id}", [](auto self, req_t req, rp_t rp) { return self->handleBulk(req, rp["id"]); }
+        , REQUEST_BODY_MAX, false);
+
+    add(verb::get, "/torrent/{info_hash}/history", [](auto self, req_t req, rp_t rp) {
+            return self->handleTorrentHistory(req, rp["info_hash"]);
+        }, REQUEST_BODY_MAX, false);
+    add(verb::get, "/torrent/{info_hash}/files", [](auto self, req_t req, rp_t rp) {
+            return self->handleTorrentFiles(req, rp["info_hash"]);
+        });
+    add(verb::get, "/torrent/{info_hash}/pieces", [](auto self, req_t req, rp_t rp) {
+            return self->handleTorrentPieces(req, rp["info_hash"]);
+        });
+    for (auto const m : {verb::get, verb::head, verb::delete_, verb::put})
+        add(m, "/torrent/{info_hash}", [](auto self, req_t req, rp_t rp) {
+            return self->handleTorrent(req, rp["info_hash"], {});
+        });
+    for (auto const m : {verb::get, verb::delete_, verb::put})
+        add(m, "/torrent/{info_hash}/{act}", [](auto self, req_t req, rp_t rp) {
+            return self->handleTorrent(req, rp["info_hash"], rp["act"]);
+        });
+}
 
 const std::optional<http::response<string_body>>
 httpCaller::
 sbCall(http::request<string_body> const& req)
 {
-	if (req.target().find("/api/") == std::string_view::npos) return std::nullopt;
-	auto uri = req.target().substr(4);
-	// Strip query string if present
-	auto query_pos = uri.find('?');
-	if (query_pos != std::string_view::npos) {
-		uri = uri.substr(0, query_pos);
+	std::string_view uri(req.target());
+	// scraped by prometheus at its conventional path, outside /api
+	if (uri.substr(0, uri.find('?')) == "/metrics"sv)
+	{
+		if (req.method() != verb::get)
+		{
+			auto res = make_resp<string_body>(req, "Method not allowed", ctText, status::method_not_allowed);
+			res.set(field::allow, "GET");
+			return res;
+		}
+		return handleMetrics(req);
+	}
+	if (!uri.starts_with("/api/"sv)) return std::nullopt;
+	// Strip "/api" and the query string
+	uri = uri.substr(4, uri.find('?') - 4);
+
+	route_params rp;
+	route const* r = nullptr;
+	switch (routes_.match(req.method(), uri, rp, r)) {
+	case router<route>::result::found:
+		return r->fn(req, rp);
+	case router<route>::result::method_not_allowed:
+	{
+		auto res = make_resp<string_body>(req, "Method not allowed", ctText, status::method_not_allowed);
+		res.set(field::allow, routes_.allowed(uri));
+		return res;
 	}
-	if (req.method() == verb::get && uri == "/session"sv) return handleSessionInfo(req);
-	if (req.method() == verb::get && uri == "/session/stats"sv) return handleSessionStats(req);
-	if (req.method() == verb::get && uri == "/sync/stats"sv) return handleSyncStats(req);
-	if (uri == "/torrents"sv) return handleTorrents(req);
+	case router<route>::result::not_found:
+		break;
+	}
+	return std::nullopt;
+}
+
+httpCaller::route const*
+httpCaller::
+find_route(http::verb method, std::string_view target) const noexcept
+{
+	if (!target.starts_with("/api/"sv)) return nullptr;
+	target = target.substr(4, target.find('?') - 4);
+	route_params rp;
+	route const* r = nullptr;
+	if (routes_.match(method, target, rp, r) != router<route>::result::found) return nullptr;
+	return r;
+}
 
-    if (uri.find("/torrent/") == 0) return handleTorrent(req, 13); // len(/api/torrent/) == 13
+std::size_t
+httpCaller::
+body_limit(http::verb method, std::string_view target) const noexcept
+{
+	auto const r = find_route(method, target);
+	return r ? r->body_limit : REQUEST_BODY_MAX;
+}
 
-    if (req.method() == verb::put && uri == "/session/toggle"sv)
-        return handleSessionToggle(req);
+bool
+httpCaller::
+offloaded(http::verb method, std::string_view target) const noexcept
+{
+	auto const r = find_route(method, target);
+	return r && r->offload;
+}
 
-    // TODO: more routes
-    return std::nullopt;
+bool
+httpCaller::
+admit_query() noexcept
+{
+	if (query_stats_.inflight.fetch_add(1) >= QUERY_QUEUE_MAX)
+	{
+		--query_stats_.inflight;
+		++query_stats_.rejected;
+		return false;
+	}
+	++query_stats_.queries;
+	return true;
 }
 
 http::response<string_body>
@@ -66,6 +191,28 @@ handleSessionStats(http::request<string_body> const& req)
 	return make_resp<string_body>(req, json::serialize(shth_->getSessionStats()), ctJSON);
 }
 
+http::response<string_body>
+httpCaller::
+handleSessionHistory(http::request<string_body> const& req)
+{
+	std::string_view const target(req.target());
+	std::int64_t range = 600;
+	auto const r = query_arg(target, "range");
+	if (!r.empty() && !parse_duration(r, range)) return make_resp_400(req, "invalid range");
+
+	std::vector<int> metrics;
+	for (auto m = query_arg(target, "metric"); !m.empty(); )
+	{
+		auto const comma = m.find(',');
+		auto const name = m.substr(0, comma);
+		auto const idx = session_history::find(name);
+		if (idx < 0) return make_resp_400(req, "unknown metric " + std::string(name));
+		metrics.push_back(idx);
+		m = comma == std::string_view::npos ? std::string_view{} : m.substr(comma + 1);
+	}
+	return make_resp<string_body>(req, json::serialize(shth_->history().to_json(metrics, range)), ctJSON);
+}
+
 http::response<string_body>
 httpCaller::
 handleSessionToggle(http::request<string_body> const& req)
@@ -81,12 +228,250 @@ handleSyncStats(http::request<string_body> const& req)
 	return make_resp<string_body>(req, json::serialize(shth_->getSyncStats()), ctJSON);
 }
 
+http::response<string_body>
+httpCaller::
+handleDht(http::request<string_body> const& req)
+{
+	return make_resp<string_body>(req, *shth_->getDhtStats(), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handlePeers(http::request<string_body> const& req)
+{
+	return make_resp<string_body>(req, *shth_->getPeers(), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handleTrackers(http::request<string_body> const& req)
+{
+	return make_resp<string_body>(req, json::serialize(shth_->getTrackers()), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handleStreams(http::request<string_body> const& req)
+{
+	return make_resp<string_body>(req, json::serialize(streams_.to_json()), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handleServerStats(http::request<string_body> const& req)
+{
+	return make_resp<string_body>(req, json::serialize(json::value({
+		 {"compress", zip_stats_.to_json()}
+		,{"uploads", uploads_.to_json()}
+		,{"queries", json::object({
+			 {"queries", query_stats_.queries.load()}
+			,{"inflight", query_stats_.inflight.load()}
+			,{"rejected", query_stats_.rejected.load()}
+			,{"timeouts", query_stats_.timeouts.load()}
+			,{"abandoned", query_stats_.abandoned.load()}
+		})}
+		,{"assets", assets_.size()}
+		,{"torrentHistory", json::object({
+			 {"torrents", shth_->torrent_histories().size()}
+			,{"dropped", shth_->torrent_histories().dropped.load()}
+		})}
+		,{"pools", json::object({
+			 {"http", http_loop_.to_json()}
+			,{"queries", query_pool_.to_json()}
+			,{"compress", zip_pool_.to_json()}
+			,{"torrent", shth_->getPoolStats()}
+		})}
+		,{"affinity", affinity_}
+	})), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handleMetrics(http::request<string_body> const& req)
+{
+	using namespace std::chrono;
+	auto const snap = shth_->metrics().snapshot();
+	std::string out;
+	out.reserve((snap ? snap->size() : 0) + 4096);
+	if (snap) out.append(*snap);
+
+	// our own counters are cheap atomics, read at scrape time
+	prom_writer w(out);
+	auto const& sm = shth_->metrics();
+	auto const now_us = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	w.gauge("kedge_session_stats_age_seconds", sm.updated_us ? (now_us - sm.updated_us) / 1e6 : -1.0);
+	w.counter("kedge_session_stats_renders_total", sm.renders.load());
+	w.counter("kedge_session_stats_render_seconds_total", sm.render_us / 1e6);
+
+	w.counter("kedge_compress_responses_total", zip_stats_.responses.load());
+	w.counter("kedge_compress_skipped_total", zip_stats_.skipped.load());
+	w.counter("kedge_compress_in_bytes_total", zip_stats_.bytes_in.load());
+	w.counter("kedge_compress_out_bytes_total", zip_stats_.bytes_out.load());
+	w.counter("kedge_compress_cpu_seconds_total", zip_stats_.cpu_us / 1e6);
+
+	w.counter("kedge_uploads_total", uploads_.uploads.load());
+	w.counter("kedge_upload_bytes_total", uploads_.bytes.load());
+	w.gauge("kedge_upload_max_bytes", uploads_.max_bytes.load());
+	w.counter("kedge_upload_rejected_total", uploads_.rejected.load());
+	w.counter("kedge_upload_buffers_reused_total", uploads_.reused.load());
+	w.counter("kedge_torrent_parses_total", uploads_.parsed.load());
+	w.counter("kedge_torrent_parse_seconds_total", uploads_.parse_us / 1e6);
+
+	w.counter("kedge_queries_total", query_stats_.queries.load());
+	w.gauge("kedge_queries_inflight", query_stats_.inflight.load());
+	w.counter("kedge_queries_rejected_total", query_stats_.rejected.load());
+	w.counter("kedge_queries_timeouts_total", query_stats_.timeouts.load());
+	w.counter("kedge_queries_abandoned_total", query_stats_.abandoned.load());
+
+	w.counter("kedge_streams_total", streams_.streams.load());
+	w.counter("kedge_stream_bytes_total", streams_.bytes.load());
+	w.counter("kedge_stream_stalls_total", streams_.stalls.load());
+	w.counter("kedge_stream_stall_seconds_total", streams_.stall_ms / 1e3);
+	w.counter("kedge_streams_aborted_total", streams_.aborted.load());
+
+	w.gauge("kedge_resume_pending", std::int64_t(shth_->num_outstanding_resume_data.load()));
+	w.gauge("kedge_resume_writing", std::int64_t(shth_->num_pending_writes.load()));
+	w.counter("kedge_resume_saved_total", shth_->num_resume_saved.load());
+	w.counter("kedge_resume_failed_total", shth_->num_resume_failed.load());
+
+#ifndef TORRENT_DISABLE_DHT
+	// left out until the dht_bootstrap_alert, after a warm or a cold start
+	if (auto const ms = shth_->dht_bootstrap_ms(); ms >= 0)
+		w.gauge("kedge_dht_bootstrap_seconds", ms / 1e3);
+#endif
+	w.gauge("kedge_tracker_hosts_suppressed", std::int64_t(shth_->trackers().num_suppressed()));
+	w.counter("kedge_tracker_suppressions_total", shth_->trackers().num_suppressions());
+	w.counter("kedge_peer_sweeps_total", shth_->peer_sweeps().sweeps.load());
+	w.gauge("kedge_peer_sweep_seconds", shth_->peer_sweeps().sweep_us / 1e6);
+	w.gauge("kedge_static_assets", std::int64_t(assets_.size()));
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		w.gauge("kedge_websocket_clients", std::int64_t(sessions_.size()));
+	}
+
+	w.gauge("kedge_http_loop_lag_seconds", http_loop_.lag_us / 1e6);
+	w.gauge("kedge_http_loop_max_lag_seconds", http_loop_.max_lag_us / 1e6);
+
+	std::pair<std::string_view, pool_stats const*> const pools[] = {
+		 {"pool=\"queries\"", &query_pool_}
+		,{"pool=\"compress\"", &zip_pool_}
+		,{"pool=\"resume_writers\"", &shth_->writer_stats_}
+		,{"pool=\"parsers\"", &shth_->parser_stats_}
+		,{"pool=\"trackers\"", &shth_->tracker_stats_}
+	};
+	w.type("kedge_pool_threads", "gauge");
+	for (auto const& [l, p] : pools) w.sample("kedge_pool_threads", std::int64_t(p->threads), l);
+	w.type("kedge_pool_queued", "gauge");
+	for (auto const& [l, p] : pools) w.sample("kedge_pool_queued", p->queued.load(), l);
+	w.type("kedge_pool_running", "gauge");
+	for (auto const& [l, p] : pools) w.sample("kedge_pool_running", p->running.load(), l);
+	w.type("kedge_pool_tasks_total", "counter");
+	for (auto const& [l, p] : pools) w.sample("kedge_pool_tasks_total", p->tasks.load(), l);
+	w.type("kedge_pool_busy_seconds_total", "counter");
+	for (auto const& [l, p] : pools) w.sample("kedge_pool_busy_seconds_total", p->busy_us / 1e6, l);
+
+	return make_resp<string_body>(req, std::move(out), ctMetrics);
+}
+
+bool
+httpCaller::
+compressing(http::response<string_body>& res, coding c)
+{
+    if (compress_level_ <= 0 || res.body().size() < COMPRESS_MIN) return false;
+    if (res.count(field::content_encoding) || !compressible(res[field::content_type])) return false;
+    res.set(field::vary, "Accept-Encoding");
+    return c != coding::identity;
+}
+
+void
+httpCaller::
+compress_async(http::response<string_body>&& res, coding c,
+    std::function<void(http::response<string_body>&&)> done)
+{
+    tracked_post(zippers_, zip_pool_, [this, c, res = std::move(res), done = std::move(done)]() mutable
+    {
+        auto const t0 = thread_cpu_us();
+        std::string out;
+        auto const in = res.body().size();
+        if (compress(res.body(), out, c, compress_level_) && out.size() < in)
+        {
+            zip_stats_.record(in, out.size(), thread_cpu_us() - t0);
+            res.body() = std::move(out);
+            res.set(field::content_encoding, coding_name(c));
+            res.prepare_payload();
+        }
+        else ++zip_stats_.skipped;
+        done(std::move(res));
+    });
+}
+
+bool
+httpCaller::
+is_content(std::string_view target) noexcept
+{
+    // hex or base32, as the router takes {info_hash}
+    std::string_view hash, index;
+    lt::sha1_hash ih;
+    return content_target(target, hash, index) && parse_info_hash(ih, hash);
+}
+
+std::optional<http::response<string_body>>
+httpCaller::
+openContent(http::request<string_body> const& req, http_stream& stream,
+    std::shared_ptr<content_stream>& out)
+{
+    if (req.method() != verb::get && req.method() != verb::head)
+        return make_resp_400(req, "Unsupported method");
+
+    std::string_view hash, num;
+    lt::sha1_hash ih;
+    if (!content_target(req.target(), hash, num) || !parse_info_hash(ih, hash))
+        return make_resp_400(req, "invalid hash string");
+
+    int idx = 0;
+    auto const [ptr, ec] = std::from_chars(num.data(), num.data() + num.size(), idx);
+    if (ec != std::errc() || ptr != num.data() + num.size())
+        return make_resp_400(req, "invalid file index");
+
+    content_plan plan;
+    if (!shth_->plan_content(ih, idx, plan)) return make_resp_404(req);
+
+    std::int64_t first = 0;
+    std::int64_t last = plan.file_size - 1;
+    auto const range = req[http::field::range];
+    bool const partial = !range.empty();
+    if (partial && !parse_range(range, plan.file_size, first, last))
+    {
+        auto res = make_resp<string_body>(req, "", ctText, status::range_not_satisfiable);
+        res.set(field::content_range, "bytes */" + std::to_string(plan.file_size));
+        return res;
+    }
+    if (plan.file_size == 0) return make_resp<string_body>(req, "", mime_type(plan.path));
+
+    response<empty_body> res{partial ? status::partial_content : status::ok, req.version()};
+    res.set(field::server, SERVER_SIGNATURE);
+    res.set(field::content_type, mime_type(plan.path));
+    res.set(field::accept_ranges, "bytes");
+    if (partial)
+    {
+        res.set(field::content_range, "bytes " + std::to_string(first) + "-"
+            + std::to_string(last) + "/" + std::to_string(plan.file_size));
+    }
+    res.content_length(last - first + 1);
+    res.keep_alive(req.keep_alive());
+
+    PLOGD_(WebLog) << "stream " << plan.path << " " << first << "-" << last;
+    out = std::make_shared<content_stream>(stream, std::move(plan), first, last, std::move(res), streams_);
+    return std::nullopt;
+}
+
 http::response<string_body>
 httpCaller::
 handleTorrents(http::request<string_body> const& req) // get or post
 {
     if (req.method() == verb::get) {
-        return make_resp<string_body>(req, json::serialize(shth_->get_torrents()), ctJSON);
+        bool const spark = query_arg(req.target(), "spark") == "1"sv;
+        return make_resp<string_body>(req, json::serialize(shth_->get_torrents(spark)), ctJSON);
     }
 
 	if (req.method() == verb::post) {
@@ -97,7 +482,16 @@ handleTorrents(http::request<string_body> const& req) // get or post
 			dir = savePath->value();
 		}
         if (req[http::field::content_type] == ctTorrent) {
-            if (shth_->add_torrent(req.body().data(), req.body().size(), dir)) {
+            // decoded in place from the request buffer
+            auto const t0 = std::chrono::steady_clock::now();
+            lt::error_code ec;
+            auto ti = std::make_shared<lt::torrent_info>(req.body().data(), int(req.body().size()), ec);
+            uploads_.record_parse(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - t0).count());
+            if (ec) {
+                return make_resp_400(req, "invalid metainfo: " + ec.message());
+            }
+            if (shth_->add_torrent(std::move(ti), dir)) {
                 return make_resp_204(req);
             }
             return make_resp_500(req, "failed to add with metainfo");
@@ -111,25 +505,105 @@ handleTorrents(http::request<string_body> const& req) // get or post
 }
 
 
-// handle a torrent with GET or POST or DELETE
+// POST {"action": "...", "hashes": [...]} or {"action": "...", "filter": {...}}
 http::response<string_body>
 httpCaller::
-handleTorrent(http::request<string_body> const& req, size_t const offset)
+handleBatch(http::request<string_body> const& req)
 {
-	// len(/api/torrent/{info_hash}/{act}?) >= 4 + 9 + 40
-	std::string_view target(req.target());
-	// Strip query string if present
-	auto query_pos = target.find('?');
-	if (query_pos != std::string_view::npos) {
-		target = target.substr(0, query_pos);
-	}
-	const std::string s(target);
-	const size_t ih_size = 40;
-	const size_t min_size = offset+ih_size;
-	if (s.size() < min_size) return make_resp_404(req);
+    json::error_code ec;
+    auto const jv = json::parse(req.body(), ec);
+    if (ec || !jv.is_object()) return make_resp_400(req, "invalid json");
+    auto const& obj = jv.get_object();
+
+    auto const* av = obj.if_contains("action");
+    if (av == nullptr || !av->is_string()) return make_resp_400(req, "missing action");
+    std::string_view const action = av->get_string();
+    batch_action act;
+    if (action == "pause"sv) act = batch_action::pause;
+    else if (action == "resume"sv || action == "start"sv) act = batch_action::resume;
+    else if (action == "toggle"sv) act = batch_action::toggle;
+    else if (action == "recheck"sv) act = batch_action::recheck;
+    else if (action == "remove"sv) act = batch_action::remove;
+    else if (action == "remove_data"sv || action == "with_data"sv) act = batch_action::remove_data;
+    else return make_resp_400(req, "unknown action");
+
+    std::vector<lt::sha1_hash> hashes;
+    json::array invalid;
+    if (auto const* hv = obj.if_contains("hashes"); hv != nullptr && hv->is_array())
+    {
+        hashes.reserve(hv->get_array().size());
+        for (auto const& v : hv->get_array())
+        {
+            lt::sha1_hash ih;
+            if (v.is_string() && parse_info_hash(ih, {v.get_string().data(), v.get_string().size()}))
+            {
+                hashes.push_back(ih);
+                continue;
+            }
+            invalid.emplace_back(json::object({{"info_hash", v}, {"ok", false}, {"error", "invalid hash string"}}));
+        }
+    }
+    else if (auto const* fv = obj.if_contains("filter"); fv != nullptr && fv->is_object())
+    {
+        auto const& fo = fv->get_object();
+        torrent_filter f;
+        if (auto const* v = fo.if_contains("state"); v && v->is_int64()) f.state = int(v->get_int64());
+        if (auto const* v = fo.if_contains("paused"); v && v->is_bool()) f.paused = v->get_bool();
+        if (auto const* v = fo.if_contains("finished"); v && v->is_bool()) f.finished = v->get_bool();
+        if (auto const* v = fo.if_contains("save_path"); v && v->is_string()) f.save_path = v->get_string();
+        if (auto const* v = fo.if_contains("name"); v && v->is_string()) f.name = v->get_string();
+        hashes = shth_->filter_torrents(f);
+    }
+    else
+    {
+        return make_resp_400(req, "missing hashes or filter");
+    }
+
+    auto ret = shth_->batch_torrents(act, hashes);
+    for (auto& v : invalid) ret.emplace_back(std::move(v));
+    return make_resp<string_body>(req, json::serialize(ret), ctJSON);
+}
+
+// POST a multipart or NDJSON body of torrents, GET /{id} for its progress
+http::response<string_body>
+httpCaller::
+handleBulk(http::request<string_body> const& req, std::string_view const id_str)
+{
+    if (req.method() == verb::post && id_str.empty())
+    {
+        std::string dir;
+        auto savePath = req.find("x-save-path");
+        if (savePath != req.end()) {
+            dir = savePath->value();
+        }
+        auto const id = shth_->ingest_bulk(req.body()
+            , std::string(req[http::field::content_type]), std::move(dir));
+        json::object ret({{"job", id}});
+        return make_resp<string_body>(req, json::serialize(ret), ctJSON, status::accepted);
+    }
 
+    if (req.method() == verb::get && !id_str.empty())
+    {
+        std::uint64_t id = 0;
+        auto const [ptr, ec] = std::from_chars(id_str.data(), id_str.data() + id_str.size(), id);
+        if (ec != std::errc() || ptr != id_str.data() + id_str.size())
+            return make_resp_400(req, "invalid job id");
+        auto const job = shth_->find_job(id);
+        if (!job) return make_resp_404(req);
+        return make_resp<string_body>(req, json::serialize(job->to_json()), ctJSON);
+    }
+
+    return make_resp_400(req, "Unsupported method");
+}
+
+// handle a torrent with GET or HEAD or PUT or DELETE
+http::response<string_body>
+httpCaller::
+handleTorrent(http::request<string_body> const& req, std::string_view const hash
+	, std::string_view const act)
+{
 	lt::sha1_hash ih;
-	if (!from_hex(ih, s.substr(offset, ih_size)))
+	if (!parse_info_hash(ih, hash))
 	{
 		return make_resp_400(req, "invalid hash string");
 	}
@@ -141,16 +615,10 @@ handleTorrent(http::request<string_body> const& req, size_t const offset)
 		}
 		return make_resp_404(req);
 	}
-	std::string act = "";
-	if (s.size() > min_size + 1)
-	{
-		act = s.substr(min_size + 1);
-	}
 	if (req.method() == verb::get)
 	{
 		auto flag = sheath::query_basic;
 		if ("peers" == act) flag = sheath::query_peers;
-		else if ("files" == act) flag = sheath::query_files;
 		auto jv = shth_->get_torrent(ih, flag);
 		if (jv.is_null()) { return make_resp_404(req); }
 		return make_resp<string_body>(req, json::serialize(jv), ctJSON);
@@ -174,6 +642,56 @@ handleTorrent(http::request<string_body> const& req, size_t const offset)
     return make_resp_400(req, "Unsupported method");
 }
 
+http::response<string_body>
+httpCaller::
+handleTorrentHistory(http::request<string_body> const& req, std::string_view const hash)
+{
+	lt::sha1_hash ih;
+	if (!parse_info_hash(ih, hash)) return make_resp_400(req, "invalid hash string");
+	auto jv = shth_->torrent_histories().to_json(ih);
+	if (jv.is_null()) return make_resp_404(req);
+	return make_resp<string_body>(req, json::serialize(jv), ctJSON);
+}
+
+// ?offset=&limit= pages the list, ?tree=1&dir=a/b lists one directory of the tree
+http::response<string_body>
+httpCaller::
+handleTorrentFiles(http::request<string_body> const& req, std::string_view const hash)
+{
+	lt::sha1_hash ih;
+	if (!parse_info_hash(ih, hash)) return make_resp_400(req, "invalid hash string");
+
+	std::string_view const target(req.target());
+	file_query q;
+	auto const number = [](std::string_view v, int& n)
+	{
+		auto const [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), n);
+		return ec == std::errc() && ptr == v.data() + v.size() && n >= 0;
+	};
+	auto const offset = query_arg(target, "offset");
+	auto const limit = query_arg(target, "limit");
+	if (!offset.empty() && !number(offset, q.offset)) return make_resp_400(req, "invalid offset");
+	if (!limit.empty() && !number(limit, q.limit)) return make_resp_400(req, "invalid limit");
+	q.tree = query_arg(target, "tree") == "1"sv;
+	if (q.tree) q.dir = url_decode(std::string(query_arg(target, "dir")));
+	q.paged = q.tree || !offset.empty() || !limit.empty();
+
+	auto body = shth_->get_files(ih, q);
+	if (!body) return make_resp_404(req);
+	return make_resp<string_body>(req, std::move(*body), ctJSON);
+}
+
+http::response<string_body>
+httpCaller::
+handleTorrentPieces(http::request<string_body> const& req, std::string_view const hash)
+{
+	lt::sha1_hash ih;
+	if (!parse_info_hash(ih, hash)) return make_resp_400(req, "invalid hash string");
+	auto const body = shth_->get_pieces(ih);
+	if (!body) return make_resp_404(req);
+	return make_resp<string_body>(req, *body, ctJSON);
+}
+
 void
 httpCaller::
 join(websocket_session* wss)
@@ -248,6 +766,7 @@ void
 httpCaller::
 doLoop()
 {
+    assets_.refresh();
     if (sessions_.empty())
     {
     	std::this_thread::sleep_for(std::chrono::seconds(20));
@@ -0,0 +1,139 @@
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "hash_codec.hpp"
+
+namespace btd {
+
+namespace {
+
+constexpr char hex_digits[] = "0123456789abcdef";
+constexpr char base32_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+constexpr std::uint8_t bad = 0xff;
+
+constexpr std::array<std::uint8_t, 256>
+make_hex_values() noexcept
+{
+    std::array<std::uint8_t, 256> t{};
+    for (auto& v : t) v = bad;
+    for (int i = 0; i < 10; ++i) t['0' + i] = std::uint8_t(i);
+    for (int i = 0; i < 6; ++i)
+    {
+        t['a' + i] = std::uint8_t(10 + i);
+        t['A' + i] = std::uint8_t(10 + i);
+    }
+    return t;
+}
+
+constexpr std::array<std::uint8_t, 256>
+make_base32_values() noexcept
+{
+    std::array<std::uint8_t, 256> t{};
+    for (auto& v : t) v = bad;
+    for (int i = 0; i < 26; ++i)
+    {
+        t['A' + i] = std::uint8_t(i);
+        t['a' + i] = std::uint8_t(i);
+    }
+    for (int i = 0; i < 6; ++i) t['2' + i] = std::uint8_t(26 + i);
+    return t;
+}
+
+// two chars for every byte value, one lookup per byte
+constexpr std::array<char, 512>
+make_hex_pairs() noexcept
+{
+    std::array<char, 512> t{};
+    for (int i = 0; i < 256; ++i)
+    {
+        t[i * 2] = hex_digits[i >> 4];
+        t[i * 2 + 1] = hex_digits[i & 15];
+    }
+    return t;
+}
+
+constexpr auto hex_values = make_hex_values();
+constexpr auto base32_values = make_base32_values();
+constexpr auto hex_pairs = make_hex_pairs();
+
+} // namespace
+
+void
+encode_hex(std::span<char const> in, char* out) noexcept
+{
+    for (char const c : in)
+    {
+        std::memcpy(out, &hex_pairs[std::uint8_t(c) * 2], 2);
+        out += 2;
+    }
+}
+
+bool
+decode_hex(std::string_view in, std::span<char> out) noexcept
+{
+    if (in.size() != hex_size(out.size())) return false;
+    // validate first so out stays untouched on failure
+    std::uint8_t any = 0;
+    for (char const c : in) any |= hex_values[std::uint8_t(c)];
+    if (any == bad) return false;
+    for (std::size_t i = 0; i < out.size(); ++i)
+    {
+        out[i] = char(hex_values[std::uint8_t(in[i * 2])] << 4
+            | hex_values[std::uint8_t(in[i * 2 + 1])]);
+    }
+    return true;
+}
+
+bool
+is_hex(std::string_view in) noexcept
+{
+    for (char const c : in)
+        if (hex_values[std::uint8_t(c)] == bad) return false;
+    return true;
+}
+
+void
+encode_base32(std::span<char const> in, char* out) noexcept
+{
+    std::uint32_t buf = 0;
+    int bits = 0;
+    for (char const c : in)
+    {
+        buf = (buf << 8) | std::uint8_t(c);
+        bits += 8;
+        while (bits >= 5)
+        {
+            bits -= 5;
+            *out++ = base32_digits[(buf >> bits) & 31];
+        }
+    }
+    if (bits > 0) *out++ = base32_digits[(buf << (5 - bits)) & 31];
+}
+
+bool
+decode_base32(std::string_view in, std::span<char> out) noexcept
+{
+    if (in.size() != base32_size(out.size())) return false;
+    std::uint8_t any = 0;
+    for (char const c : in) any |= base32_values[std::uint8_t(c)];
+    if (any == bad) return false;
+
+    std::uint32_t buf = 0;
+    int bits = 0;
+    std::size_t n = 0;
+    for (char const c : in)
+    {
+        buf = (buf << 5) | base32_values[std::uint8_t(c)];
+        bits += 5;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[n++] = char((buf >> bits) & 0xff);
+        }
+    }
+    return true;
+}
+
+} // namespace btd
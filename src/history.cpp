@@ -0,0 +1,307 @@
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+#include <libtorrent/session_stats.hpp>
+
+#include "history.hpp"
+
+namespace btd {
+
+namespace {
+
+struct metric_def
+{
+    std::string_view name;
+    char const* counter;
+    bool rate; // bytes per second of the counter, else its value
+};
+
+// named as in /api/session/stats
+constexpr metric_def defs[] = {
+     {"rateRecv", "net.recv_bytes", true}
+    ,{"rateSent", "net.sent_bytes", true}
+    ,{"rateDataRecv", "net.recv_payload_bytes", true}
+    ,{"rateDataSent", "net.sent_payload_bytes", true}
+    ,{"rateWasted", "net.recv_redundant_bytes", true}
+    ,{"rateFailed", "net.recv_failed_bytes", true}
+    ,{"numPeersConnected", "peer.num_peers_connected", false}
+    ,{"numPeersHalfOpen", "peer.num_peers_half_open", false}
+    ,{"numDownloading", "ses.num_downloading_torrents", false}
+    ,{"numSeeding", "ses.num_seeding_torrents", false}
+    ,{"numChecking", "ses.num_checking_torrents", false}
+    ,{"bytesQueued", "disk.queued_write_bytes", false}
+    ,{"dhtNodes", "dht.dht_nodes", false}
+};
+constexpr std::size_t num_metrics = std::size(defs);
+
+constexpr float missing = std::numeric_limits<float>::quiet_NaN();
+
+} // namespace
+
+session_history::
+session_history()
+    : prev_(num_metrics, 0)
+{
+    for (auto const& d : defs) index_.push_back(lt::find_metric_idx(d.counter));
+    for (auto const& s : tiers)
+    {
+        tier t{s.step, s.slots};
+        t.values.assign(std::size_t(s.slots) * num_metrics, missing);
+        t.sum.assign(num_metrics, 0.0);
+        t.count.assign(num_metrics, 0);
+        tiers_.push_back(std::move(t));
+    }
+}
+
+std::vector<std::string_view>
+session_history::
+names()
+{
+    std::vector<std::string_view> ret;
+    for (auto const& d : defs) ret.push_back(d.name);
+    return ret;
+}
+
+int
+session_history::
+find(std::string_view name) noexcept
+{
+    for (std::size_t i = 0; i < num_metrics; ++i)
+        if (defs[i].name == name) return int(i);
+    return -1;
+}
+
+void
+session_history::
+tier::
+close(std::size_t metrics)
+{
+    if (open < 0) return;
+    // buckets the clock skipped over had no sample
+    for (auto b = std::max(last + 1, open - slots + 1); b < open; ++b)
+        std::fill_n(values.begin() + (b % slots) * metrics, metrics, missing);
+    auto const slot = values.begin() + (open % slots) * metrics;
+    for (std::size_t m = 0; m < metrics; ++m)
+    {
+        slot[m] = count[m] ? float(sum[m] / count[m]) : missing;
+        sum[m] = 0.0;
+        count[m] = 0;
+    }
+    last = open;
+}
+
+float
+session_history::
+tier::
+value(std::int64_t bucket, std::size_t metric, std::size_t metrics) const
+{
+    if (bucket == open) return count[metric] ? float(sum[metric] / count[metric]) : missing;
+    if (bucket < 0 || bucket > last || bucket <= last - slots) return missing;
+    return values[(bucket % slots) * metrics + metric];
+}
+
+void
+session_history::
+update(lt::span<std::int64_t const> counters, std::int64_t t)
+{
+    // from the alert thread only, prev_ needs no lock
+    std::array<double, num_metrics> sample;
+    double const dt = prev_t_ < 0 ? 0.0 : (t - prev_t_) / 1e6;
+    for (std::size_t i = 0; i < num_metrics; ++i)
+    {
+        sample[i] = std::numeric_limits<double>::quiet_NaN();
+        auto const idx = index_[i];
+        if (idx < 0 || idx >= std::ptrdiff_t(counters.size())) continue;
+        auto const v = counters[idx];
+        if (!defs[i].rate) sample[i] = double(v);
+        else if (dt > 0) sample[i] = double(v - prev_[i]) / dt;
+        prev_[i] = v;
+    }
+    prev_t_ = t;
+
+    auto const now = std::int64_t(std::time(nullptr));
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& tr : tiers_)
+    {
+        auto const b = now / tr.step;
+        if (b != tr.open)
+        {
+            tr.close(num_metrics);
+            tr.open = b;
+        }
+        for (std::size_t i = 0; i < num_metrics; ++i)
+        {
+            if (std::isnan(sample[i])) continue;
+            tr.sum[i] += sample[i];
+            ++tr.count[i];
+        }
+    }
+}
+
+json::value
+session_history::
+to_json(std::vector<int> const& metrics, std::int64_t range) const
+{
+    auto const& last_spec = tiers[std::size(tiers) - 1];
+    std::size_t ti = std::size(tiers) - 1;
+    for (std::size_t i = 0; i < std::size(tiers); ++i)
+    {
+        if (std::int64_t(tiers[i].step) * tiers[i].slots >= range) { ti = i; break; }
+    }
+    range = std::min(range, std::int64_t(last_spec.step) * last_spec.slots);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const& tr = tiers_[ti];
+    auto const n = std::clamp<std::int64_t>((range + tr.step - 1) / tr.step, 1, tr.slots);
+    auto const end = tr.open >= 0 ? tr.open : std::int64_t(std::time(nullptr)) / tr.step;
+    auto const first = end - n + 1;
+
+    json::object series;
+    auto const add = [&](std::size_t m)
+    {
+        json::array points;
+        points.reserve(std::size_t(n));
+        for (auto b = first; b <= end; ++b)
+        {
+            auto const v = tr.value(b, m, num_metrics);
+            if (std::isnan(v)) points.emplace_back(nullptr);
+            else points.emplace_back(std::int64_t(std::llround(v)));
+        }
+        series.emplace(defs[m].name, std::move(points));
+    };
+    if (metrics.empty())
+        for (std::size_t m = 0; m < num_metrics; ++m) add(m);
+    else
+        for (auto const m : metrics) add(std::size_t(m));
+
+    return json::value({
+         {"step", tr.step}
+        ,{"start", first * tr.step}
+        ,{"series", std::move(series)}
+    });
+}
+
+std::uint16_t
+torrent_history::
+pack_rate(std::int64_t v) noexcept
+{
+    if (v <= 0) return 0;
+    auto m = std::uint64_t(std::min<std::int64_t>(v, std::int64_t(1) << 40));
+    unsigned e = 0;
+    while (m > 2047)
+    {
+        m = (m + 1) >> 1;
+        ++e;
+    }
+    return std::uint16_t(e << 11 | m);
+}
+
+std::int64_t
+torrent_history::
+unpack_rate(std::uint16_t v) noexcept
+{
+    return std::int64_t(v & 2047) << (v >> 11);
+}
+
+void
+torrent_history::
+update(std::vector<lt::torrent_status> const& st)
+{
+    constexpr std::int64_t slots = TORRENT_HISTORY_SLOTS;
+    auto const now = std::int64_t(std::time(nullptr)) / TORRENT_HISTORY_STEP;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& t : st)
+    {
+        auto it = tracks_.find(t.info_hash);
+        if (it == tracks_.end())
+        {
+            if (tracks_.size() >= TORRENT_HISTORY_MAX)
+            {
+                ++dropped;
+                continue;
+            }
+            it = tracks_.emplace(t.info_hash, track{}).first;
+        }
+        auto& tr = it->second;
+        auto const b = std::max(now, tr.last);
+        if (tr.last < 0) tr.first = b;
+        else
+        {
+            // nothing changed in the buckets between
+            auto const prev = tr.ring[tr.last % slots];
+            for (auto i = std::max(tr.last + 1, b - slots + 1); i < b; ++i) tr.ring[i % slots] = prev;
+        }
+        tr.ring[b % slots] = sample{
+             pack_rate(t.download_payload_rate)
+            ,pack_rate(t.upload_payload_rate)
+            ,std::uint16_t(std::clamp(t.num_peers, 0, 65535))
+            ,std::uint16_t(t.progress_ppm / (PERCENT_DONE / PERCENT_ONE))
+        };
+        tr.last = b;
+    }
+}
+
+void
+torrent_history::
+remove(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracks_.erase(ih);
+}
+
+std::size_t
+torrent_history::
+size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tracks_.size();
+}
+
+json::value
+torrent_history::
+to_json(lt::sha1_hash const& ih, int points) const
+{
+    constexpr std::int64_t slots = TORRENT_HISTORY_SLOTS;
+    auto const n = std::clamp<std::int64_t>(points, 1, slots);
+    auto const end = std::int64_t(std::time(nullptr)) / TORRENT_HISTORY_STEP;
+    auto const first = end - n + 1;
+
+    json::array down, up, peers, progress;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto const it = tracks_.find(ih);
+        if (it == tracks_.end()) return json::value(nullptr);
+        auto const& tr = it->second;
+        for (auto b = first; b <= end; ++b)
+        {
+            if (b < tr.first || b <= tr.last - slots)
+            {
+                down.emplace_back(nullptr);
+                up.emplace_back(nullptr);
+                peers.emplace_back(nullptr);
+                progress.emplace_back(nullptr);
+                continue;
+            }
+            // past the newest sample the torrent has not changed since
+            auto const& s = tr.ring[std::min(b, tr.last) % slots];
+            down.emplace_back(unpack_rate(s.down));
+            up.emplace_back(unpack_rate(s.up));
+            peers.emplace_back(s.peers);
+            progress.emplace_back(std::int64_t(s.progress) * (PERCENT_DONE / PERCENT_ONE));
+        }
+    }
+    return json::value({
+         {"step", TORRENT_HISTORY_STEP}
+        ,{"start", first * TORRENT_HISTORY_STEP}
+        ,{"down", std::move(down)}
+        ,{"up", std::move(up)}
+        ,{"peers", std::move(peers)}
+        ,{"progress", std::move(progress)}
+    });
+}
+
+} // namespace btd
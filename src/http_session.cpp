@@ -1,6 +1,16 @@
 
+#include <boost/asio/bind_cancellation_slot.hpp>
+#include <boost/asio/cancellation_signal.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include "compress.hpp"
 #include "net.hpp"
 #include "http_util.hpp"
+#include "shared_body.hpp"
 #include "http_session.hpp"
 #include "http_websocket.hpp"
 #include "handlers.hpp"
@@ -47,9 +57,59 @@ handle_request(
     auto opt_resp = caller->sbCall(req);
     if (opt_resp) return send(opt_resp.value());
 
-    // Build the path to the requested file
-    std::string path = path_cat(caller->ui_root(), req.target());
-    if(req.target().back() == '/')
+    // Static files of the web ui, the query is only for cache busting
+    auto target = req.target();
+    target = target.substr(0, target.find('?'));
+    if (auto const asset = caller->assets().find(target))
+    {
+        auto const set_common = [&asset](auto& res)
+        {
+            res.set(field::server, SERVER_SIGNATURE);
+            res.set(field::etag, asset->etag);
+            res.set(field::last_modified, asset->last_modified);
+            res.set(field::cache_control, "no-cache");
+            if (asset->gzip) res.set(field::vary, "Accept-Encoding");
+        };
+
+        // Revalidation is answered from memory
+        auto const inm = req[field::if_none_match];
+        bool const fresh = inm.empty()
+            ? req[field::if_modified_since] == asset->last_modified
+            : inm.find(asset->etag) != std::string_view::npos || inm == "*";
+        if (fresh)
+        {
+            response<empty_body> res{status::not_modified, req.version()};
+            set_common(res);
+            res.keep_alive(req.keep_alive());
+            return send(std::move(res));
+        }
+
+        auto body = asset->raw;
+        if (asset->gzip && accepted_coding(req[field::accept_encoding]) == coding::gzip)
+            body = asset->gzip;
+
+        response<shared_body> res{
+            std::piecewise_construct,
+            std::make_tuple(std::move(body)),
+            std::make_tuple(status::ok, req.version())};
+        set_common(res);
+        res.set(field::content_type, asset->mime);
+        if (res.body() == asset->gzip)
+            res.set(field::content_encoding, coding_name(coding::gzip));
+        res.content_length(res.body()->size());
+        res.keep_alive(req.keep_alive());
+        // HEAD gets the same header without a body
+        if (req.method() == verb::head)
+        {
+            response<empty_body> head{std::move(res.base())};
+            return send(std::move(head));
+        }
+        return send(std::move(res));
+    }
+
+    // Build the path to the requested file, those over the cache limit
+    std::string path = path_cat(caller->ui_root(), target);
+    if(target.back() == '/')
         path.append("index.html");
 
     // Attempt to open the file
@@ -59,7 +119,7 @@ handle_request(
 
     // Handle the case where the file doesn't exist
     if(ec == boost::system::errc::no_such_file_or_directory)
-        return send(not_found(req.target()));
+        return send(not_found(target));
 
     // Handle an unknown error
     if(ec)
@@ -93,9 +153,53 @@ handle_request(
 
 //------------------------------------------------------------------------------
 
+template<class Response>
+void
+http_session::
+send(Response&& response)
+{
+    // The lifetime of the message has to extend
+    // for the duration of the async operation so
+    // we use a shared_ptr to manage it.
+    using response_type = typename std::decay<Response>::type;
+    auto sp = std::make_shared<response_type>(std::forward<Response>(response));
+
+    // Large API responses are compressed on a worker, then written from our strand
+    if constexpr (std::is_same_v<response_type, http::response<http::string_body>>)
+    {
+        if (caller_->compressing(*sp, accept_))
+        {
+            caller_->compress_async(std::move(*sp), accept_,
+                [self = shared_from_this()](http::response<http::string_body>&& res)
+                {
+                    auto sp = std::make_shared<response_type>(std::move(res));
+                    net::post(self->stream_.get_executor(),
+                        [self, sp] { self->write(sp); });
+                });
+            return;
+        }
+    }
+    write(std::move(sp));
+}
+
+template<class Message>
+void
+http_session::
+write(std::shared_ptr<Message> sp)
+{
+    // Write the response
+    auto self = shared_from_this();
+    http::async_write(stream_, *sp,
+        [self, sp](
+            beast::error_code ec, std::size_t bytes)
+        {
+            self->on_write(ec, bytes, sp->need_eof());
+        });
+}
+
 http_session::
 http_session(
-    tcp::socket&& socket,
+    stream_protocol::socket&& socket,
     std::shared_ptr<httpCaller> const& caller)
     : stream_(std::move(socket))
     , caller_(caller)
@@ -126,26 +230,82 @@ http_session::
 do_read()
 {
     // Construct a new parser for each message
-    parser_.emplace();
-
-    // Apply a reasonable limit to the allowed size
-    // of the body in bytes to prevent abuse.
-    // 1MB limit to accommodate large torrent files
-    parser_->body_limit(1048576);
+    header_parser_.emplace();
+    pooled_ = false;
 
     // Set the timeout.
     stream_.expires_after(std::chrono::seconds(30));
 
-    // Read a request
+    // Read the header, the body limit is chosen by route
+    http::async_read_header(
+        stream_,
+        buffer_,
+        *header_parser_,
+        beast::bind_front_handler(
+            &http_session::on_read_header,
+            shared_from_this()));
+}
+
+void
+http_session::
+on_read_header(beast::error_code ec, std::size_t)
+{
+    // This means they closed the connection
+    if(ec == http::error::end_of_stream || ec == beast::error::timeout)
+    {
+        stream_.socket().shutdown(stream_protocol::socket::shutdown_send, ec);
+        return;
+    }
+
+    // Handle the error, if any
+    if(ec)
+        return fail(ec, "http on_read_header");
+
+    auto const& header = header_parser_->get();
+    auto const limit = caller_->body_limit(header.method(), header.target());
+    auto const length = header_parser_->content_length();
+
+    // Refuse an oversized body before reading any of it
+    if(length && *length > limit)
+    {
+        ++caller_->uploads().rejected;
+        auto res = make_resp<string_body>(header, "Request body too large", ctText, status::payload_too_large);
+        res.keep_alive(false);
+        return send(std::move(res));
+    }
+
+    // Uploads are read into a pooled buffer, grown as the body arrives
+    if(limit > REQUEST_BODY_MAX)
+    {
+        pooled_ = true;
+        parser_.emplace(std::move(*header_parser_),
+            caller_->uploads().acquire(length.value_or(0)));
+    }
+    else
+    {
+        parser_.emplace(std::move(*header_parser_));
+    }
+    header_parser_.reset();
+    parser_->body_limit(limit);
+
+    // Read the body
     http::async_read(
         stream_,
         buffer_,
-        parser_->get(),
+        *parser_,
         beast::bind_front_handler(
             &http_session::on_read,
             shared_from_this()));
 }
 
+http::request<http::string_body>
+http_session::
+take_request()
+{
+    auto msg = parser_->release();
+    return http::request<http::string_body>(std::move(msg.base()), std::move(msg.body()));
+}
+
 void
 http_session::
 on_read(beast::error_code ec, std::size_t)
@@ -153,11 +313,13 @@ on_read(beast::error_code ec, std::size_t)
     // This means they closed the connection
     if(ec == http::error::end_of_stream || ec == beast::error::timeout)
     {
-        stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+        stream_.socket().shutdown(stream_protocol::socket::shutdown_send, ec);
         return;
     }
 
     // Handle the error, if any
+    if(ec == http::error::body_limit)
+        ++caller_->uploads().rejected;
     if(ec)
         return fail(ec, "http on_read");
 
@@ -171,32 +333,109 @@ on_read(beast::error_code ec, std::size_t)
         return;
     }
 
+    accept_ = accepted_coding(parser_->get()[field::accept_encoding]);
+
+    // Torrent payload is written by a content stream on this connection
+    if(httpCaller::is_content(parser_->get().target()))
+    {
+        auto req = take_request();
+        std::shared_ptr<content_stream> cs;
+        if(auto res = caller_->openContent(req, stream_, cs))
+            return send(std::move(*res));
+        cs->run(req.method() == verb::head,
+            [self = shared_from_this()](beast::error_code ec, bool close)
+            {
+                self->on_write(ec, 0, close);
+            });
+        return;
+    }
+
+    // Handlers blocking on the session are awaited off the I/O threads
+    auto req = take_request();
+    if(caller_->offloaded(req.method(), req.target()))
+    {
+        if(!caller_->admit_query())
+        {
+            auto res = make_resp<string_body>(req, "Too many pending requests", ctText, status::service_unavailable);
+            res.set(field::retry_after, "1");
+            return send(std::move(res));
+        }
+        net::co_spawn(stream_.get_executor(),
+            call_api(shared_from_this(),
+                std::make_shared<http::request<http::string_body>>(std::move(req)), pooled_),
+            net::detached);
+        return;
+    }
+
     //
     // The following code requires generic
     // lambdas, available in C++14 and later.
     //
     handle_request(
         caller_,
-        parser_->release(),
+        std::move(req),
         [this](auto&& response)
         {
-            // The lifetime of the message has to extend
-            // for the duration of the async operation so
-            // we use a shared_ptr to manage it.
-            using response_type = typename std::decay<decltype(response)>::type;
-            auto sp = std::make_shared<response_type>(std::forward<decltype(response)>(response));
-
-            // Write the response
-            auto self = shared_from_this();
-            http::async_write(stream_, *sp,
-                [self, sp](
-                    beast::error_code ec, std::size_t bytes)
-                {
-                    self->on_write(ec, bytes, sp->need_eof());
-                });
-
+            send(std::forward<decltype(response)>(response));
         });
 
+    // handle_request only reads the body, give the buffer back
+    if(pooled_)
+    {
+        auto const received = req.body().size();
+        caller_->uploads().release(std::move(req.body()), received);
+    }
+
+}
+
+net::awaitable<void>
+http_session::
+call_api(std::shared_ptr<http_session> self,
+    std::shared_ptr<http::request<http::string_body>> req, bool pooled)
+{
+    // The timer cancels the query, it then completes right away.
+    // Its handler may run after we are gone, so it shares the signal.
+    auto const cancel = std::make_shared<net::cancellation_signal>();
+    net::steady_timer timer(self->stream_.get_executor(), std::chrono::seconds(QUERY_TIMEOUT));
+    timer.async_wait([cancel](beast::error_code ec)
+    {
+        if(!ec)
+            cancel->emit(net::cancellation_type::terminal);
+    });
+
+    std::optional<http::response<http::string_body>> res;
+    bool timed_out = false;
+    try
+    {
+        res = co_await self->caller_->async_call(req,
+            net::bind_cancellation_slot(cancel->slot(), net::use_awaitable));
+    }
+    catch(boost::system::system_error const&)
+    {
+        timed_out = true;
+    }
+    timer.cancel();
+
+    if(timed_out)
+    {
+        // the pool may still read the request, it keeps its own reference
+        self->caller_->count_timeout();
+        PLOGI_(WebLog) << "query timeout: " << req->method_string() << ' ' << req->target();
+        auto resp = make_resp<string_body>(*req, "The query timed out", ctText, status::gateway_timeout);
+        resp.keep_alive(false);
+        self->send(std::move(resp));
+        co_return;
+    }
+
+    if(pooled)
+    {
+        auto const received = req->body().size();
+        self->caller_->uploads().release(std::move(req->body()), received);
+    }
+    if(res)
+        self->send(std::move(*res));
+    else
+        self->send(make_resp_404(*req));
 }
 
 void
@@ -211,7 +450,7 @@ on_write(beast::error_code ec, std::size_t, bool close)
     {
         // This means we should close the connection, usually because
         // the response indicated the "Connection: close" semantic.
-        stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+        stream_.socket().shutdown(stream_protocol::socket::shutdown_send, ec);
         return;
     }
 
@@ -20,7 +20,7 @@ namespace btd {
 
 websocket_session::
 websocket_session(
-    tcp::socket&& socket,
+    stream_protocol::socket&& socket,
     std::shared_ptr<httpCaller> const& caller)
     : ws_(std::move(socket))
     , caller_(caller)
@@ -0,0 +1,279 @@
+
+#include <boost/beast/core/detail/base64.hpp>
+#include <boost/json/parse.hpp>
+
+#include "ingest.hpp"
+#include "log.hpp"
+
+namespace btd {
+
+using namespace std::literals;
+
+namespace {
+
+char const*
+state_name(ingest_state st)
+{
+    switch (st) {
+    case ingest_state::queued: return "queued";
+    case ingest_state::submitted: return "submitted";
+    case ingest_state::added: return "added";
+    case ingest_state::failed: return "failed";
+    }
+    return "";
+}
+
+// value of key="..." or key=... in a part header
+std::string
+header_param(std::string_view headers, std::string_view key)
+{
+    auto pos = headers.find(key);
+    if (pos == std::string_view::npos) return "";
+    auto v = headers.substr(pos + key.size());
+    if (!v.empty() && v.front() == '"')
+    {
+        v.remove_prefix(1);
+        return std::string(v.substr(0, v.find('"')));
+    }
+    return std::string(v.substr(0, v.find_first_of(";\r\n")));
+}
+
+std::string
+decode_base64(std::string_view s)
+{
+    namespace base64 = boost::beast::detail::base64;
+    std::string out(base64::decoded_size(s.size()), '\0');
+    auto const r = base64::decode(out.data(), s.data(), s.size());
+    out.resize(r.first);
+    return out;
+}
+
+} // namespace
+
+std::string_view
+multipart_boundary(std::string_view content_type)
+{
+    if (!content_type.starts_with("multipart/")) return {};
+    auto const pos = content_type.find("boundary=");
+    if (pos == std::string_view::npos) return {};
+    auto b = content_type.substr(pos + 9);
+    if (!b.empty() && b.front() == '"')
+    {
+        b.remove_prefix(1);
+        return b.substr(0, b.find('"'));
+    }
+    return b.substr(0, b.find(';'));
+}
+
+bool
+split_multipart(std::string_view body, std::string_view boundary,
+    std::vector<ingest_source>& out)
+{
+    std::string const delim = "--" + std::string(boundary);
+    std::string const next_delim = "\r\n" + delim;
+
+    auto pos = body.find(delim);
+    if (pos == std::string_view::npos) return false;
+    pos += delim.size();
+    for (;;)
+    {
+        // "--" after a delimiter closes the body
+        if (body.substr(pos, 2) == "--"sv) return true;
+        auto const head_end = body.find("\r\n\r\n"sv, pos);
+        if (head_end == std::string_view::npos) return false;
+        auto const headers = body.substr(pos, head_end - pos);
+        auto const start = head_end + 4;
+        auto const next = body.find(next_delim, start);
+        if (next == std::string_view::npos) return false;
+
+        ingest_source src;
+        src.data = body.substr(start, next - start);
+        src.name = header_param(headers, "filename="sv);
+        if (src.name.empty()) src.name = header_param(headers, "name="sv);
+        src.magnet = src.data.starts_with("magnet:"sv);
+        if (!src.data.empty()) out.push_back(std::move(src));
+
+        pos = next + next_delim.size();
+    }
+}
+
+void
+split_ndjson(std::string_view body, std::vector<ingest_source>& out)
+{
+    while (!body.empty())
+    {
+        auto const nl = body.find('\n');
+        auto line = body.substr(0, nl);
+        body = nl == std::string_view::npos ? std::string_view{} : body.substr(nl + 1);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+        if (line.empty()) continue;
+
+        ingest_source src;
+        if (line.starts_with("magnet:"sv))
+        {
+            src.data = line;
+            src.magnet = true;
+            out.push_back(std::move(src));
+            continue;
+        }
+
+        json::error_code ec;
+        auto const jv = json::parse(line, ec);
+        if (ec || !(jv.is_object() || jv.is_string()))
+        {
+            src.name = std::string(line.substr(0, 64));
+            src.error = ec ? "invalid line: " + ec.message() : "invalid line";
+            out.push_back(std::move(src));
+            continue;
+        }
+        if (jv.is_string())
+        {
+            src.owned = std::string(jv.get_string());
+            src.magnet = true;
+            out.push_back(std::move(src));
+            continue;
+        }
+
+        auto const& obj = jv.get_object();
+        auto const str = [&obj](std::string_view key) -> std::string
+        {
+            auto const* v = obj.if_contains(key);
+            if (v == nullptr || !v->is_string()) return "";
+            return std::string(v->get_string());
+        };
+        src.name = str("name");
+        src.save_path = str("save_path");
+        if (auto m = str("magnet"); !m.empty())
+        {
+            src.owned = std::move(m);
+            src.magnet = true;
+        }
+        else if (auto t = str("torrent"); !t.empty())
+        {
+            src.owned = decode_base64(t);
+            if (src.owned.empty()) src.error = "invalid base64 torrent";
+        }
+        else
+        {
+            src.error = "neither magnet nor torrent";
+        }
+        out.push_back(std::move(src));
+    }
+}
+
+ingest_job::
+ingest_job(std::uint64_t id, std::string body, std::string content_type,
+    std::string save_path)
+    : id(id)
+    , created(std::time(nullptr))
+    , body(std::move(body))
+    , content_type(std::move(content_type))
+    , save_path(std::move(save_path))
+{
+}
+
+std::size_t
+ingest_job::
+split()
+{
+    std::vector<ingest_source> sources;
+    auto const boundary = multipart_boundary(content_type);
+    if (!boundary.empty())
+    {
+        if (!split_multipart(body, boundary, sources))
+            LOG_WARNING << "ingest job " << id << ": truncated multipart body";
+    }
+    else
+    {
+        split_ndjson(body, sources);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sources_ = std::move(sources);
+    items_.resize(sources_.size());
+    for (std::size_t i = 0; i < sources_.size(); ++i)
+    {
+        items_[i].name = sources_[i].name;
+        if (!sources_[i].error.empty())
+        {
+            items_[i].state = ingest_state::failed;
+            items_[i].error = sources_[i].error;
+            ++failed_;
+        }
+    }
+    split_ = true;
+    return sources_.size();
+}
+
+void
+ingest_job::
+submit(std::size_t idx, std::string info_hash)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& item = items_[idx];
+    item.info_hash = std::move(info_hash);
+    item.state = ingest_state::submitted;
+    ++submitted_;
+}
+
+void
+ingest_job::
+done(std::size_t idx, std::string const& error)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& item = items_[idx];
+    if (item.state == ingest_state::added || item.state == ingest_state::failed) return;
+    if (item.state == ingest_state::submitted) --submitted_;
+    if (error.empty())
+    {
+        item.state = ingest_state::added;
+        ++added_;
+    }
+    else
+    {
+        item.state = ingest_state::failed;
+        item.error = error;
+        ++failed_;
+    }
+}
+
+bool
+ingest_job::
+finished() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return split_ && std::size_t(added_ + failed_) == items_.size();
+}
+
+json::value
+ingest_job::
+to_json() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const total = items_.size();
+    char const* state = "splitting";
+    if (split_) state = std::size_t(added_ + failed_) == total ? "done" : "running";
+
+    json::array arr;
+    arr.reserve(total);
+    for (auto const& item : items_)
+    {
+        json::object obj({{"state", state_name(item.state)}});
+        if (!item.name.empty()) obj.emplace("name", item.name);
+        if (!item.info_hash.empty()) obj.emplace("info_hash", item.info_hash);
+        if (!item.error.empty()) obj.emplace("error", item.error);
+        arr.emplace_back(std::move(obj));
+    }
+    return json::value({
+         {"id", id}
+        ,{"created", created}
+        ,{"state", state}
+        ,{"total", total}
+        ,{"submitted", submitted_}
+        ,{"added", added_}
+        ,{"failed", failed_}
+        ,{"items", std::move(arr)}
+    });
+}
+
+} // namespace btd
@@ -1,6 +1,9 @@
 
+#include <filesystem>
 #include <iostream>
 
+#include <boost/asio/local/stream_protocol.hpp>
+
 #include "listener.hpp"
 #include "http_session.hpp"
 #include "log.hpp"
@@ -10,11 +13,13 @@ namespace btd {
 listener::
 listener(
     net::io_context& ioc,
-    tcp::endpoint endpoint,
-    std::shared_ptr<httpCaller> const& caller)
+    stream_protocol::endpoint endpoint,
+    std::shared_ptr<httpCaller> const& caller,
+    bool reuse_port)
     : ioc_(ioc)
     , acceptor_(ioc)
     , caller_(caller)
+    , reuse_port_(reuse_port)
 {
     beast::error_code ec;
 
@@ -34,6 +39,22 @@ listener(
         return;
     }
 
+    // Let the kernel spread connections over the acceptors of the port
+    if(reuse_port_)
+    {
+#ifdef SO_REUSEPORT
+        using reuse_port_option = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        acceptor_.set_option(reuse_port_option(true), ec);
+#else
+        ec = net::error::operation_not_supported;
+#endif
+        if(ec)
+        {
+            fail(ec, "set_option reuse_port");
+            return;
+        }
+    }
+
     // Bind to the server address
     acceptor_.bind(endpoint, ec);
     if(ec)
@@ -52,13 +73,22 @@ listener(
     }
 }
 
+net::any_io_executor
+listener::
+session_executor()
+{
+    if(reuse_port_)
+        return ioc_.get_executor();
+    // The new connection gets its own strand
+    return net::make_strand(ioc_);
+}
+
 void
 listener::
 run()
 {
-    // The new connection gets its own strand
     acceptor_.async_accept(
-        net::make_strand(ioc_),
+        session_executor(),
         beast::bind_front_handler(
             &listener::on_accept,
             shared_from_this()));
@@ -78,7 +108,7 @@ fail(beast::error_code ec, char const* what)
 // Handle a connection
 void
 listener::
-on_accept(beast::error_code ec, tcp::socket socket)
+on_accept(beast::error_code ec, stream_protocol::socket socket)
 {
     if(ec)
         return fail(ec, "accept");
@@ -88,12 +118,39 @@ on_accept(beast::error_code ec, tcp::socket socket)
             std::move(socket),
             caller_)->run();
 
-    // The new connection gets its own strand
     acceptor_.async_accept(
-        net::make_strand(ioc_),
+        session_executor(),
         beast::bind_front_handler(
             &listener::on_accept,
             shared_from_this()));
 }
 
+std::shared_ptr<listener>
+make_unix_listener(
+    net::io_context& ioc,
+    std::string const& path,
+    unsigned mode,
+    std::shared_ptr<httpCaller> const& caller)
+{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    // left over from a previous run, bind fails while it exists
+    if (fs::is_socket(path, ec)) fs::remove(path, ec);
+
+    auto l = std::make_shared<listener>(
+        ioc,
+        net::local::stream_protocol::endpoint(path),
+        caller);
+
+    fs::permissions(path, static_cast<fs::perms>(mode), ec);
+    if (ec)
+        PLOGW_(WebLog) << "failed to chmod " << path << ": " << ec.message();
+    return l;
+#else
+    PLOGW_(WebLog) << "unix domain sockets are not supported, not listening on " << path;
+    return nullptr;
+#endif
+}
+
 } // namespace btd
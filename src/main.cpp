@@ -6,11 +6,13 @@
 #include <boost/asio/signal_set.hpp>
 
 #include "const.hpp"
+#include "dir_watcher.hpp"
 #include "handlers.hpp"
 #include "listener.hpp"
 #include "log.hpp"
 #include "option.hpp"
 #include "sheath.hpp"
+#include "thread_util.hpp"
 #include "util.hpp"
 
 #include "plog/Initializers/RollingFileInitializer.h"
@@ -36,35 +38,92 @@ int main(int argc, char* argv[])
     Option opt;
     if (!opt.init_from(argc, argv)) { return EXIT_FAILURE; }
 
-    const auto ctx = opt.make_context();
+    // libtorrent threads and the sheath pools inherit the torrent cpus
+    const auto ctx = [&opt] {
+        scoped_affinity pin(opt.cpuTorrent);
+        return opt.make_context();
+    }();
 
     std::thread ctx_start_loader([&ctx] {
         ctx->start();
     });
 
-    const auto caller = std::make_shared<httpCaller>(ctx, opt.webuiRoot);
+    // the query and compression pools inherit the blocking cpus
+    const auto caller = [&opt, &ctx] {
+        scoped_affinity pin(opt.cpuBlocking);
+        return std::make_shared<httpCaller>(ctx, opt.webuiRoot, opt.queryThreads);
+    }();
+    caller->set_compress_level(opt.compressLevel);
+    caller->set_affinity(json::object({
+         {"http", cpus_json(opt.cpuHttp)}
+        ,{"alert", cpus_json(opt.cpuAlert)}
+        ,{"torrent", cpus_json(opt.cpuTorrent)}
+        ,{"blocking", cpus_json(opt.cpuBlocking)}
+    }));
 
     // main: web server
 
-    boost::system::error_code ec;
-    auto address = net::ip::make_address(opt.httpAddr, ec);
-    if (ec) {
-        std::cerr << "invalid addr " << opt.httpAddr << " reason " << ec.message();
+    // "none" leaves only the unix domain socket
+    bool const on_tcp = !opt.httpAddr.empty() && opt.httpAddr != "none";
+    if (!on_tcp && opt.httpUnix.empty()) {
+        std::cerr << "no http listener, set --http-addr or --http-unix" << std::endl;
         return EXIT_FAILURE;
     }
-    auto port = opt.httpPort;
-    auto const threads = std::max<int>(1, std::thread::hardware_concurrency()/2 -1);
 
-    std::cerr << "start http server on " << address << ":" << port << std::endl;
+    boost::system::error_code ec;
+    net::ip::address address;
+    if (on_tcp) {
+        address = net::ip::make_address(opt.httpAddr, ec);
+        if (ec) {
+            std::cerr << "invalid addr " << opt.httpAddr << " reason " << ec.message();
+            return EXIT_FAILURE;
+        }
+    }
+    auto port = opt.httpPort;
+    auto const threads = opt.httpThreads;
 
     // The io_context is required for all I/O
     net::io_context ioc;
 
     // Create and launch a listening port
-    std::make_shared<listener>(
-        ioc,
-        tcp::endpoint{address, port},
-        caller)->run();
+    if (on_tcp) {
+        std::cerr << "start http server on " << address << ":" << port << std::endl;
+        std::make_shared<listener>(
+            ioc,
+            tcp::endpoint{address, port},
+            caller,
+            opt.reusePort)->run();
+    }
+
+    // Local callers can skip the tcp stack, access goes by file mode
+    if (!opt.httpUnix.empty()) {
+        std::cerr << "start http server on " << opt.httpUnix << std::endl;
+        if (auto l = make_unix_listener(ioc, opt.httpUnix, opt.httpUnixMode, caller))
+            l->run();
+    }
+
+    // Shared-nothing mode: one more io_context and acceptor per thread
+    std::vector<std::unique_ptr<net::io_context>> iocs;
+    if (on_tcp && opt.reusePort)
+    {
+        for(auto i = threads - 1; i > 0; --i)
+        {
+            auto& c = *iocs.emplace_back(std::make_unique<net::io_context>(1));
+            std::make_shared<listener>(
+                c,
+                tcp::endpoint{address, port},
+                caller,
+                true)->run();
+            std::make_shared<loop_probe>(c, caller->http_loop())->run();
+        }
+    }
+
+    // Ingest watch directories on inotify events, polling stays as fallback
+    std::make_shared<dir_watcher>(ioc, ctx)->run();
+
+    // Measure how late the loop runs its handlers
+    caller->http_loop().threads = threads;
+    std::make_shared<loop_probe>(ioc, caller->http_loop())->run();
 
     // Capture SIGINT and SIGTERM to perform a clean shutdown
     net::signal_set signals(ioc, SIGINT, SIGTERM);
@@ -83,20 +142,26 @@ int main(int argc, char* argv[])
     tv.reserve(threads - 1);
     for(auto i = threads - 1; i > 0; --i)
         tv.emplace_back(
-        [&ioc]
+        [c = iocs.empty() ? &ioc : iocs[i - 1].get(), &opt]
         {
-            ioc.run();
+            pin_thread(opt.cpuHttp);
+            c->run();
         });
 
-    std::thread shth_loader([&ctx, &ioc] {
+    std::thread shth_loader([&ctx, &ioc, &iocs, &opt] {
+        pin_thread(opt.cpuAlert);
         while (!quit)
         {
             ctx->doLoop();
         }
+        // flush resume data while the API can still report progress
+        ctx->save_all_resume();
+        for (auto& c : iocs) c->stop();
         ioc.stop();
     });
 
-    std::thread caller_loader([&caller] {
+    std::thread caller_loader([&caller, &opt] {
+        pin_thread(opt.cpuHttp);
         while (!quit)
         {
             caller->doLoop();
@@ -104,6 +169,7 @@ int main(int argc, char* argv[])
     });
 
     std::cerr << "http server running" << std::endl;
+    pin_thread(opt.cpuHttp);
     ioc.run(); // forever
     std::cerr << "http server ran ?" << std::endl;
     caller->closeWS();
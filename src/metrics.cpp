@@ -0,0 +1,107 @@
+
+#include <charconv>
+#include <chrono>
+
+#include <libtorrent/session_stats.hpp>
+
+#include "metrics.hpp"
+
+namespace btd {
+
+void
+prom_writer::
+type(std::string_view name, std::string_view type)
+{
+    out_.append("# TYPE ");
+    out_.append(name);
+    out_.push_back(' ');
+    out_.append(type);
+    out_.push_back('\n');
+}
+
+void
+prom_writer::
+value(std::int64_t v)
+{
+    char buf[24];
+    auto const r = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, r.ptr);
+}
+
+void
+prom_writer::
+value(double v)
+{
+    char buf[32];
+    auto const r = std::to_chars(buf, buf + sizeof(buf), v);
+    out_.append(buf, r.ptr);
+}
+
+session_metrics::
+session_metrics()
+{
+    auto const all = lt::session_stats_metrics();
+    metrics_.reserve(all.size());
+    for (auto const& m : all)
+    {
+        // "net.sent_bytes" as libtorrent_net_sent_bytes_total
+        std::string name = "libtorrent_";
+        for (char const* p = m.name; *p; ++p) name.push_back(*p == '.' ? '_' : *p);
+        bool const counter = m.type == lt::metric_type_t::counter;
+        if (counter) name.append("_total");
+
+        std::string head;
+        prom_writer(head).type(name, counter ? "counter" : "gauge");
+        head.append(name);
+        head.push_back(' ');
+        metrics_.push_back({std::move(head), m.value_index});
+    }
+    for (auto& b : bufs_) b = std::make_shared<std::string>();
+}
+
+void
+session_metrics::
+update(lt::span<std::int64_t const> counters)
+{
+    using namespace std::chrono;
+    auto const t0 = steady_clock::now();
+
+    // only the alert thread renders, the published buffer is still
+    // referenced by current_ and those held by scrapes are skipped
+    std::shared_ptr<std::string> buf;
+    for (auto const& b : bufs_)
+    {
+        if (b.use_count() == 1) { buf = b; break; }
+    }
+    if (!buf) return;
+
+    buf->clear();
+    for (auto const& m : metrics_)
+    {
+        if (m.index < 0 || std::ptrdiff_t(m.index) >= std::ptrdiff_t(counters.size())) continue;
+        buf->append(m.head);
+        char num[24];
+        auto const r = std::to_chars(num, num + sizeof(num), counters[m.index]);
+        buf->append(num, r.ptr);
+        buf->push_back('\n');
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_ = std::move(buf);
+    }
+    auto const t1 = steady_clock::now();
+    ++renders;
+    render_us += duration_cast<microseconds>(t1 - t0).count();
+    updated_us = duration_cast<microseconds>(t1.time_since_epoch()).count();
+}
+
+std::shared_ptr<std::string const>
+session_metrics::
+snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+}
+
+} // namespace btd
@@ -0,0 +1,220 @@
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <string_view>
+#include <unordered_set>
+
+#include <boost/json/serialize.hpp>
+#include <boost/json/value.hpp>
+#include <libtorrent/peer_info.hpp>
+
+#include "log.hpp"
+#include "peer_view.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+namespace json = boost::json;
+
+namespace {
+
+struct group
+{
+    int peers = 0;
+    std::int64_t up = 0;
+    std::int64_t down = 0;
+};
+
+// "qBittorrent 4.3.1" counts as "qBittorrent"
+std::string
+client_name(std::string const& client)
+{
+    auto const sp = client.rfind(' ');
+    if (sp != std::string::npos && sp + 1 < client.size()
+        && (std::isdigit(static_cast<unsigned char>(client[sp + 1])) || client[sp + 1] == 'v'))
+        return client.substr(0, sp);
+    return client.empty() ? std::string("unknown") : client;
+}
+
+// the /24 of an IPv4 address, the /48 of an IPv6 one
+std::string
+prefix_of(lt::address const& a)
+{
+    if (a.is_v4())
+    {
+        auto b = a.to_v4().to_bytes();
+        b[3] = 0;
+        return lt::address_v4(b).to_string() + "/24";
+    }
+    auto b = a.to_v6().to_bytes();
+    std::fill(b.begin() + 6, b.end(), 0);
+    return lt::address_v6(b).to_string() + "/48";
+}
+
+json::object
+group_json(group const& g)
+{
+    return json::object({
+         {"peers", g.peers}
+        ,{"up", g.up}
+        ,{"down", g.down}
+    });
+}
+
+// the PEERS_TOP_N largest groups by upload, then download
+json::array
+top_groups(std::unordered_map<std::string, group> const& groups, std::string_view key)
+{
+    std::vector<std::pair<std::string const*, group const*>> v;
+    v.reserve(groups.size());
+    for (auto const& [k, g] : groups) v.emplace_back(&k, &g);
+    auto const n = std::min(v.size(), std::size_t(PEERS_TOP_N));
+    std::partial_sort(v.begin(), v.begin() + n, v.end(), [](auto const& a, auto const& b)
+    {
+        if (a.second->up != b.second->up) return a.second->up > b.second->up;
+        return a.second->down > b.second->down;
+    });
+    json::array ret;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        auto obj = group_json(*v[i].second);
+        obj.emplace(key, *v[i].first);
+        ret.emplace_back(std::move(obj));
+    }
+    return ret;
+}
+
+} // namespace
+
+void
+peer_view::
+sweep(std::vector<std::pair<lt::sha1_hash, lt::torrent_handle>> const& active)
+{
+    auto const t0 = std::chrono::steady_clock::now();
+
+    // torrents without peers now, or gone, keep nothing
+    std::unordered_set<lt::sha1_hash> live;
+    for (auto const& a : active) live.insert(a.first);
+    for (auto it = peers_.begin(); it != peers_.end(); )
+        it = live.count(it->first) ? std::next(it) : peers_.erase(it);
+
+    auto const n = std::min(active.size(), std::size_t(PEERS_SWEEP_TORRENTS));
+    if (cursor_ >= active.size()) cursor_ = 0;
+    std::vector<lt::peer_info> info;
+    for (std::size_t k = 0; k < n; ++k)
+    {
+        auto const& [ih, th] = active[(cursor_ + k) % active.size()];
+        info.clear();
+        try
+        {
+            th.get_peer_info(info);
+        }
+        catch (std::exception const& e)
+        {
+            // removed since the list was taken
+            PLOGD << "peer sweep skips " << to_hex(ih) << ": " << e.what();
+            peers_.erase(ih);
+            continue;
+        }
+        auto& v = peers_[ih];
+        v.clear();
+        for (auto const& p : info)
+        {
+            if (p.flags & (lt::peer_info::connecting | lt::peer_info::handshake)) continue;
+            v.push_back(peer{
+                 p.client
+                ,p.ip.address()
+                ,p.ip.port()
+                ,p.up_speed
+                ,p.down_speed
+                ,bool(p.flags & lt::peer_info::utp_socket)
+            });
+        }
+    }
+    cursor_ = active.empty() ? 0 : (cursor_ + n) % active.size();
+
+    auto snap = std::make_shared<std::string const>(render(active.size()));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        snapshot_ = std::move(snap);
+    }
+    ++sweeps;
+    sweep_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+std::string
+peer_view::
+render(std::size_t torrents) const
+{
+    group tcp, utp;
+    std::unordered_map<std::string, group> clients, prefixes;
+    // the PEERS_TOP_N fastest of each direction
+    struct ranked
+    {
+        lt::sha1_hash const* ih;
+        peer const* p;
+    };
+    std::vector<ranked> all;
+    for (auto const& [ih, v] : peers_)
+    {
+        for (auto const& p : v)
+        {
+            for (auto* g : {p.utp ? &utp : &tcp, &clients[client_name(p.client)], &prefixes[prefix_of(p.addr)]})
+            {
+                ++g->peers;
+                g->up += p.up;
+                g->down += p.down;
+            }
+            all.push_back({&ih, &p});
+        }
+    }
+
+    auto const top = [&](int peer::* rate)
+    {
+        auto const n = std::min(all.size(), std::size_t(PEERS_TOP_N));
+        std::partial_sort(all.begin(), all.begin() + n, all.end(), [rate](auto const& a, auto const& b)
+        {
+            return a.p->*rate > b.p->*rate;
+        });
+        json::array ret;
+        for (std::size_t i = 0; i < n && all[i].p->*rate > 0; ++i)
+        {
+            auto const& p = *all[i].p;
+            ret.emplace_back(json::object({
+                 {"infoHash", to_hex(*all[i].ih)}
+                ,{"ip", p.addr.to_string()}
+                ,{"port", p.port}
+                ,{"client", p.client}
+                ,{"up", p.up}
+                ,{"down", p.down}
+                ,{"uTP", p.utp}
+            }));
+        }
+        return ret;
+    };
+
+    return json::serialize(json::value({
+         {"updated", std::time(nullptr)}
+        ,{"torrents", torrents}
+        ,{"sampled", peers_.size()}
+        ,{"peers", all.size()}
+        ,{"transport", json::object({{"tcp", group_json(tcp)}, {"utp", group_json(utp)}})}
+        ,{"clients", top_groups(clients, "client")}
+        ,{"prefixes", top_groups(prefixes, "prefix")}
+        ,{"topUpload", top(&peer::up)}
+        ,{"topDownload", top(&peer::down)}
+    }));
+}
+
+std::shared_ptr<std::string const>
+peer_view::
+snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return snapshot_;
+}
+
+} // namespace btd
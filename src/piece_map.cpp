@@ -0,0 +1,126 @@
+
+#include <algorithm>
+
+#include <boost/beast/core/detail/base64.hpp>
+
+#include "piece_map.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+namespace {
+
+std::string
+base64(std::string const& in)
+{
+    namespace b64 = boost::beast::detail::base64;
+    std::string out(b64::encoded_size(in.size()), '\0');
+    out.resize(b64::encode(out.data(), in.data(), in.size()));
+    return out;
+}
+
+void
+append_varint(std::string& out, std::size_t v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back(char((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+// runs of equal values, stops once it is no smaller than limit
+bool
+rle(std::vector<std::uint8_t> const& v, std::size_t limit, std::string& out)
+{
+    for (std::size_t i = 0; i < v.size(); )
+    {
+        auto j = i + 1;
+        while (j < v.size() && v[j] == v[i]) ++j;
+        append_varint(out, j - i);
+        out.push_back(char(v[i]));
+        if (out.size() >= limit) return false;
+        i = j;
+    }
+    return true;
+}
+
+std::string
+encoded(std::string_view encoding, std::string const& data)
+{
+    std::string ret = R"({"encoding":")";
+    ret.append(encoding);
+    ret.append(R"(","data":")");
+    ret.append(base64(data));
+    ret.append(R"("})");
+    return ret;
+}
+
+} // namespace
+
+std::string
+encode_have(std::vector<bool> const& have)
+{
+    std::string bits((have.size() + 7) / 8, '\0');
+    std::vector<std::uint8_t> values(have.size());
+    for (std::size_t i = 0; i < have.size(); ++i)
+    {
+        if (!have[i]) continue;
+        bits[i / 8] |= char(0x80 >> (i % 8));
+        values[i] = 1;
+    }
+    std::string runs;
+    if (rle(values, bits.size(), runs)) return encoded("rle", runs);
+    return encoded("bits", bits);
+}
+
+std::string
+encode_counts(std::vector<int> const& counts)
+{
+    std::string bytes(counts.size(), '\0');
+    std::vector<std::uint8_t> values(counts.size());
+    for (std::size_t i = 0; i < counts.size(); ++i)
+    {
+        values[i] = std::uint8_t(std::clamp(counts[i], 0, 255));
+        bytes[i] = char(values[i]);
+    }
+    std::string runs;
+    if (rle(values, bytes.size(), runs)) return encoded("rle", runs);
+    return encoded("bytes", bytes);
+}
+
+std::shared_ptr<std::string const>
+piece_cache::
+find(lt::sha1_hash const& ih) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = entries_.find(ih);
+    if (it == entries_.end() || it->second.expires < std::chrono::steady_clock::now()) return {};
+    return it->second.body;
+}
+
+void
+piece_cache::
+store(lt::sha1_hash const& ih, std::shared_ptr<std::string const> body)
+{
+    auto const now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.size() >= PIECES_CACHE_MAX)
+    {
+        for (auto it = entries_.begin(); it != entries_.end(); )
+            it = it->second.expires < now ? entries_.erase(it) : std::next(it);
+        if (entries_.size() >= PIECES_CACHE_MAX) entries_.erase(entries_.begin());
+    }
+    entries_[ih] = {std::move(body), now + std::chrono::seconds(PIECES_CACHE_TTL)};
+}
+
+void
+piece_cache::
+invalidate(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(ih);
+}
+
+} // namespace btd
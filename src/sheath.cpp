@@ -1,8 +1,14 @@
 
+#include <algorithm>
 #include <chrono>
 #include <ctime>
+#include <exception>
 #include <filesystem>
+#include <string_view>
+#include <thread>
 
+#include <boost/asio/post.hpp>
+#include <boost/json/serialize.hpp>
 #include <boost/json/value_from.hpp>
 #include <libtorrent/add_torrent_params.hpp>
 #include <libtorrent/bencode.hpp>
@@ -52,6 +58,26 @@ parse_endpoint(lt::tcp::endpoint & ep, std::string addr)
     return false;
 }
 
+// a rendered JSON object with "stale":true added, for a snapshot past its polling
+static std::shared_ptr<std::string const>
+mark_stale(std::string const& obj)
+{
+    std::string out(obj, 0, obj.size() - 1);
+    out.append(R"(,"stale":true})");
+    return std::make_shared<std::string const>(std::move(out));
+}
+
+/* renew the watch that keeps a snapshot polled; when it had lapsed
+   before this read, polling stopped and snap is the last one taken */
+static std::shared_ptr<std::string const>
+watched_snapshot(std::shared_ptr<std::string const> snap, std::atomic_int64_t& watched_until, int ttl)
+{
+    using namespace std::chrono;
+    auto const now = duration_cast<seconds>(lt::clock_type::now().time_since_epoch()).count();
+    bool const lapsed = watched_until.exchange(now + ttl) <= now;
+    return snap && lapsed ? mark_stale(*snap) : snap;
+}
+
 
 json::object
 torrent_status_to_json_obj(lt::torrent_status const& st)
@@ -141,9 +167,35 @@ sheath::sheath(std::shared_ptr<lt::session> const ses, std::string store_dir, st
     , dir_store(std::move(store_dir))
     , dir_moved(std::move(moved_dir))
     , dir_resumes(dir_conf / RESUME_DIR)
+    , dir_metas(dir_conf / META_DIR)
     , dir_watches(dir_conf / WATCH_DIR)
     , file_ses_state(dir_conf / SESS_FILE)
 {
+    watches_.push_back({dir_watches, ""});
+    for (int i = 0; i < RESUME_WRITERS; ++i) write_strands_.push_back(boost::asio::make_strand(writers_));
+    auto const settings = ses_->get_settings();
+#ifndef TORRENT_DISABLE_DHT
+    dht_enabled_ = settings.get_bool(lt::settings_pack::enable_dht);
+#endif
+    streamed_.write_cache = settings.get_int(lt::settings_pack::cache_size) != 0;
+}
+
+void
+sheath::add_watch_dir(std::string const& dir, std::string const& save_path)
+{
+    fs::path const p(dir);
+    for (auto const& w : watches_)
+    {
+        if (w.dir == p) return;
+    }
+    std::error_code ec;
+    if (!fs::create_directories(p, ec) && ec.value() != 0)
+    {
+        LOG_ERROR << "failed to create watch directory: " << p << ' ' << ec.message();
+        return;
+    }
+    LOG_INFO << "watching " << p << " save to: " << (save_path.empty() ? dir_store.string() : save_path);
+    watches_.push_back({p, save_path});
 }
 
 std::string
@@ -153,6 +205,93 @@ sheath::resume_file(lt::sha1_hash const& info_hash) const
     return file.string();
 }
 
+std::string
+sheath::metadata_file(lt::sha1_hash const& info_hash) const
+{
+    auto file = dir_metas / (to_hex(info_hash) + META_EXT);
+    return file.string();
+}
+
+// resume files only carry the mutable state, the info dict is kept once
+// per info-hash in the metadata cache and rejoined here
+bool
+sheath::load_resume(lt::sha1_hash const& ih, lt::add_torrent_params& p)
+{
+    std::vector<char> resume_data;
+    if (!load_file(resume_file(ih), resume_data)) return false;
+
+    lt::error_code ec;
+    auto atp = lt::read_resume_data(resume_data, ec);
+    if (ec)
+    {
+        LOG_ERROR << "failed to load resume data: " << to_hex(ih) << ' ' << ec.message();
+        return false;
+    }
+    if (atp.ti) mark_embedded(ih);
+    else atp.ti = load_metadata(ih);
+    p = std::move(atp);
+    return true;
+}
+
+std::shared_ptr<lt::torrent_info>
+sheath::load_metadata(lt::sha1_hash const& ih) const
+{
+    auto const fn = metadata_file(ih);
+    std::error_code ec_;
+    if (!fs::exists(fn, ec_)) return nullptr;
+
+    lt::error_code ec;
+    auto ti = std::make_shared<lt::torrent_info>(fn, ec);
+    if (ec)
+    {
+        LOG_WARNING << "failed to load metadata: " << fn << ", " << ec.message();
+        return nullptr;
+    }
+    if (ti->info_hash() != ih)
+    {
+        LOG_WARNING << "metadata mismatch: " << fn << " is " << to_hex(ti->info_hash());
+        return nullptr;
+    }
+    return ti;
+}
+
+// store the info dict once, it never changes for a given info-hash
+bool
+sheath::save_metadata(lt::torrent_info const& ti) const
+{
+    auto const fn = metadata_file(ti.info_hash());
+    std::error_code ec;
+    if (fs::exists(fn, ec)) return true;
+
+    int const size = ti.metadata_size();
+    if (size <= 0) return false;
+
+    // wrap the raw info section so the cached file is a regular .torrent
+    auto const md = ti.metadata();
+    std::vector<char> buf;
+    buf.reserve(std::size_t(size) + 8);
+    constexpr std::string_view head = "d4:info";
+    buf.insert(buf.end(), head.begin(), head.end());
+    buf.insert(buf.end(), md.get(), md.get() + size);
+    buf.push_back('e');
+
+    // write aside and rename, a torn file would poison the cache
+    auto const tmp = fn + ".tmp";
+    if (!save_file(tmp, buf))
+    {
+        LOG_ERROR << "failed to save metadata: " << tmp;
+        return false;
+    }
+    fs::rename(tmp, fn, ec);
+    if (ec)
+    {
+        LOG_ERROR << "failed to rename metadata: " << fn << ' ' << ec.message();
+        return false;
+    }
+    LOG_INFO << "cached metadata " << to_hex(ti.info_hash()) << ' ' << size << " bytes";
+    return true;
+}
+
 void
 sheath::load_resumes()
 {
@@ -193,6 +332,8 @@ sheath::load_resumes()
             LOG_WARNING << "failed to parse resume data: " << fn_ << ", " << ec_.message();
             continue;
         }
+        if (atp.ti) mark_embedded(atp.info_hash);
+        else atp.ti = load_metadata(atp.info_hash);
         auto end = steady_clock::now();
         duration<double> elapsed = end-start;
         std::string name("");
@@ -234,14 +375,62 @@ sheath::handle_alert(lt::alert* a)
     if (session_stats_alert* s = alert_cast<session_stats_alert>(a))
     {
         svs.updateCounters(s->counters(), duration_cast<microseconds>(s->timestamp().time_since_epoch()).count());
+        metrics_.update(s->counters());
+        history_.update(s->counters(), duration_cast<microseconds>(s->timestamp().time_since_epoch()).count());
         return true;
     }
 
 #ifndef TORRENT_DISABLE_DHT
     if (dht_stats_alert* p = alert_cast<dht_stats_alert>(a))
     {
-        dht_active_requests = p->active_requests;
-        dht_routing_table = p->routing_table;
+        int nodes = 0;
+        int replacements = 0;
+        json::array buckets;
+        for (auto const& b : p->routing_table)
+        {
+            nodes += b.num_nodes;
+            replacements += b.num_replacements;
+            buckets.emplace_back(json::object({
+                 {"nodes", b.num_nodes}
+                ,{"replacements", b.num_replacements}
+                ,{"lastActive", b.last_active}
+            }));
+        }
+        json::array lookups;
+        for (auto const& l : p->active_requests)
+        {
+            lookups.emplace_back(json::object({
+                 {"type", l.type}
+                ,{"target", to_hex(l.target)}
+                ,{"outstanding", l.outstanding_requests}
+                ,{"timeouts", l.timeouts}
+                ,{"responses", l.responses}
+                ,{"branchFactor", l.branch_factor}
+                ,{"nodesLeft", l.nodes_left}
+                ,{"lastSent", l.last_sent}
+                ,{"firstTimeout", l.first_timeout}
+            }));
+        }
+        auto snap = std::make_shared<std::string const>(json::serialize(json::value({
+             {"enabled", true}
+            ,{"updated", std::time(nullptr)}
+            ,{"warmNodes", dht_warm_nodes_}
+            ,{"bootstrapMs", dht_bootstrap_ms_.load()}
+            ,{"nodes", nodes}
+            ,{"replacements", replacements}
+            ,{"buckets", std::move(buckets)}
+            ,{"lookups", std::move(lookups)}
+        })));
+        std::lock_guard<std::mutex> lock(dht_mutex_);
+        dht_snapshot_ = std::move(snap);
+        return true;
+    }
+    if (alert_cast<dht_bootstrap_alert>(a))
+    {
+        auto const ms = duration_cast<milliseconds>(clock_type::now() - started_).count();
+        std::int64_t none = -1;
+        if (dht_bootstrap_ms_.compare_exchange_strong(none, ms))
+            LOG_INFO << "dht bootstrapped in " << ms << "ms from " << dht_warm_nodes_ << " saved nodes";
         return true;
     }
 #endif
@@ -264,21 +453,33 @@ sheath::handle_alert(lt::alert* a)
     if (metadata_received_alert* p = alert_cast<metadata_received_alert>(a))
     {
         torrent_handle h = p->handle;
-        h.save_resume_data(torrent_handle::save_info_dict);
+        if (auto ti = h.torrent_file()) save_metadata(*ti);
+        h.save_resume_data();
         ++num_outstanding_resume_data;
     }
     else if (add_torrent_alert* p = alert_cast<add_torrent_alert>(a))
     {
+        on_ingest_added(p);
         if (p->error)
         {
             LOG_WARNING << "failed to add torrent: " << p->params.name << " ih "
-                        << p->params.info_hash << ", " << p->error.message();
+                        << to_hex(p->params.info_hash) << ", " << p->error.message();
         }
         else
         {
             torrent_handle h = p->handle;
+            bool embedded = false;
+            {
+                std::lock_guard<std::mutex> lock(resume_mutex_);
+                removed_.erase(h.info_hash());
+                embedded = embedded_.erase(h.info_hash()) > 0;
+            }
+
+            // resume files written before the metadata cache still embed the
+            // info dict, move it to the cache and rewrite them without it
+            if (p->params.ti) save_metadata(*p->params.ti);
 
-            h.save_resume_data(torrent_handle::save_info_dict | torrent_handle::only_if_modified);
+            h.save_resume_data(embedded ? resume_data_flags_t{} : torrent_handle::only_if_modified);
             ++num_outstanding_resume_data;
 
             // if we have a peer specified, connect to it
@@ -297,20 +498,21 @@ sheath::handle_alert(lt::alert* a)
         // the alert handler for save_resume_data_alert
         // will save it to disk
         torrent_handle h = p->handle;
-        h.save_resume_data(torrent_handle::save_info_dict);
+        h.save_resume_data();
         ++num_outstanding_resume_data;
-        LOG_INFO << "finished " << h.info_hash() << " " << p->torrent_name();
+        LOG_INFO << "finished " << to_hex(h.info_hash()) << " " << p->torrent_name();
         on_torrent_finished(h);
     }
     else if (save_resume_data_alert* p = alert_cast<save_resume_data_alert>(a))
     {
-        LOG_INFO << "saving resume " << p->params.info_hash << " "
+        LOG_INFO << "saving resume " << to_hex(p->params.info_hash) << " "
                  << p->params.name << " a:" << pptime(p->params.added_time)
                  << " c:" << pptime(p->params.completed_time);
 
         --num_outstanding_resume_data;
-        auto const buf = lt::write_resume_data_buf(p->params);
-        save_file(resume_file(p->params.info_hash), buf);
+        // suppressed trackers are still the torrent's
+        trackers_.restore_into(p->params);
+        write_resume(p->params);
     }
     else if (save_resume_data_failed_alert* p = alert_cast<save_resume_data_failed_alert>(a))
     {
@@ -325,17 +527,87 @@ sheath::handle_alert(lt::alert* a)
         // the alert handler for save_resume_data_alert
         // will save it to disk
         torrent_handle h = p->handle;
-        LOG_INFO << "pause " << h.info_hash() << " " << p->torrent_name();
-        h.save_resume_data(torrent_handle::save_info_dict);
+        LOG_INFO << "pause " << to_hex(h.info_hash()) << " " << p->torrent_name();
+        h.save_resume_data();
         ++num_outstanding_resume_data;
     }
+    else if (file_completed_alert* p = alert_cast<file_completed_alert>(a))
+    {
+        files_.file_completed(p->handle.info_hash(), static_cast<int>(p->index));
+        return true;
+    }
+    else if (torrent_checked_alert* p = alert_cast<torrent_checked_alert>(a))
+    {
+        files_.remove(p->handle.info_hash());
+    }
+    else if (cache_flushed_alert* p = alert_cast<cache_flushed_alert>(a))
+    {
+        streamed_.flushed(p->handle.info_hash());
+        return true;
+    }
+    else if (piece_finished_alert* p = alert_cast<piece_finished_alert>(a))
+    {
+        pieces_.invalidate(p->handle.info_hash());
+        streamed_.finished(p->handle.info_hash(), static_cast<int>(p->piece_index));
+        return true;
+    }
+    else if (tracker_announce_alert* p = alert_cast<tracker_announce_alert>(a))
+    {
+        trackers_.announced(p->handle.info_hash(), p->tracker_url(), p->timestamp());
+        return true;
+    }
+    else if (tracker_reply_alert* p = alert_cast<tracker_reply_alert>(a))
+    {
+        trackers_.replied(p->handle.info_hash(), p->tracker_url(), p->num_peers, p->timestamp());
+        return true;
+    }
+    else if (tracker_error_alert* p = alert_cast<tracker_error_alert>(a))
+    {
+        std::string msg = p->error_message();
+        if (msg.empty()) msg = p->error.message();
+        auto const v = trackers_.failed(p->handle.info_hash(), p->tracker_url()
+            , p->error == errors::tracker_failure, std::move(msg));
+        if (v == tracker_health::verdict::dead)
+        {
+            auto host = tracker_host(p->tracker_url());
+            LOG_WARNING << "tracker " << host << " keeps failing, suppressed on all torrents";
+            suppress_tracker(std::move(host), {});
+        }
+        else if (v == tracker_health::verdict::suppressed)
+        {
+            suppress_tracker(tracker_host(p->tracker_url()), p->handle);
+        }
+    }
+    else if (scrape_reply_alert* p = alert_cast<scrape_reply_alert>(a))
+    {
+        trackers_.scraped(p->tracker_url(), p->complete, p->incomplete);
+        return true;
+    }
+    else if (scrape_failed_alert* p = alert_cast<scrape_failed_alert>(a))
+    {
+        std::string msg = p->error_message();
+        if (msg.empty()) msg = p->error.message();
+        trackers_.scrape_failed(p->tracker_url(), std::move(msg));
+    }
     else if (state_update_alert* p = alert_cast<state_update_alert>(a))
     {
+        torrent_history_.update(p->status);
         set_all_torrents(std::move(p->status));
         return true;
     }
     else if (torrent_removed_alert* p = alert_cast<torrent_removed_alert>(a))
     {
+        torrent_history_.remove(p->info_hash);
+        trackers_.remove(p->info_hash);
+        pieces_.invalidate(p->info_hash);
+        files_.remove(p->info_hash);
+        streamed_.remove(p->info_hash);
+        mark_removed(p->info_hash);
+        remove_resume(p->info_hash);
+        // here, not on the writers, so a quick re-add saves it again after
+        std::error_code ec;
+        fs::remove(metadata_file(p->info_hash), ec);
+        PLOG_WARNING_IF(ec) << "failed to delete metadata of " << to_hex(p->info_hash) << ' ' << ec.message();
         remove_torrent_with_handle(std::move(p->handle));
     }
     // TODO: more alerts
@@ -377,7 +649,9 @@ sheath::getSessionStats() const
 {
     auto stats = svs.getSessionStats();
     stats.isPaused = ses_->is_paused();
-    return stats.to_json_object();
+    auto obj = stats.to_json_object();
+    obj.emplace("resume", getResumeStats());
+    return obj;
 }
 
 void
@@ -399,9 +673,45 @@ sheath::save_session()
 
         std::vector<char> out;
         lt::bencode(std::back_inserter(out), session_state);
-        save_file(file_ses_state.string() , out);
+        std::uint64_t gen;
+        {
+            std::lock_guard<std::mutex> lock(ses_state_mutex_);
+            gen = ++ses_state_gen_;
+        }
+        write_session_state(out, gen);
+    }
+
+}
+
+void
+sheath::checkpoint_session()
+{
+    lt::entry session_state;
+    ses_->save_state(session_state, lt::session::save_settings | lt::session::save_dht_state);
+    std::vector<char> out;
+    lt::bencode(std::back_inserter(out), session_state);
+    std::uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lock(ses_state_mutex_);
+        gen = ++ses_state_gen_;
     }
+    tracked_post(writers_, writer_stats_, [this, out = std::move(out), gen]
+    {
+        write_session_state(out, gen);
+    });
+}
 
+// written aside then renamed, a crash keeps the previous state
+void
+sheath::write_session_state(std::vector<char> const& buf, std::uint64_t gen)
+{
+    std::lock_guard<std::mutex> lock(ses_state_mutex_);
+    if (gen != ses_state_gen_) return; // a newer one was taken
+    auto const tmp = file_ses_state.string() + ".tmp";
+    std::error_code ec;
+    if (save_file(tmp, buf)) fs::rename(tmp, file_ses_state, ec);
+    else ec = std::make_error_code(std::errc::io_error);
+    PLOG_WARNING_IF(ec) << "failed to save session state: " << ec.message();
 }
 
 void
@@ -433,12 +743,8 @@ sheath::add_magnet(std::string const& uri)
     }
     LOG_INFO << "adding magnet: '" << uri << "'";
 
-    std::vector<char> resume_data;
-    if (load_file(resume_file(p.info_hash), resume_data))
-    {
-        p = lt::read_resume_data(resume_data, ec);
-        PLOG_ERROR_IF(ec) << "failed to load resume data: " <<  ec.message();
-    }
+    // skip the metadata download when the info dict is already cached
+    if (!load_resume(p.info_hash, p) && !p.ti) p.ti = load_metadata(p.info_hash);
 
     set_torrent_params(p);
 
@@ -448,9 +754,9 @@ sheath::add_magnet(std::string const& uri)
 
 // return false on failure
 bool
-sheath::add_torrent(std::string const& filename)
+sheath::add_torrent(std::string const& filename, std::string const& save_path)
 {
-    static int counter = 0;
+    static std::atomic_int counter = 0;
 
     PLOGI.printf("[%d] %s\n", counter++, filename.c_str());
 
@@ -462,15 +768,19 @@ sheath::add_torrent(std::string const& filename)
         return false;
     }
 
-    lt::add_torrent_params p;
-
-    std::vector<char> resume_data;
-    if (load_file(resume_file(ti->info_hash()), resume_data))
+    if (!save_path.empty())
     {
-        p = lt::read_resume_data(resume_data, ec);
-        PLOG_ERROR_IF(ec) << "failed to load resume data: " <<  ec.message();
+        std::error_code ec_;
+        if (!fs::create_directories(fs::path(save_path), ec_) && ec_.value() != 0) {
+            LOG_ERROR << "failed to create directory: " << save_path << ' ' << ec_.message();
+            return false;
+        }
     }
 
+    lt::add_torrent_params p;
+    load_resume(ti->info_hash(), p);
+
+    if (!save_path.empty()) p.save_path = save_path;
     set_torrent_params(p);
 
     p.ti = ti;
@@ -489,7 +799,14 @@ sheath::add_torrent(char const* buffer, int size, std::string const& save_path)
         LOG_ERROR << "failed to load torrent from buf " << size << ' ' << ec.message();
         return false;
     }
-    LOG_INFO << "adding torrent from buf: " << size << " bytes, save to: " << save_path;
+    return add_torrent(std::move(ti), save_path);
+}
+
+bool
+sheath::add_torrent(std::shared_ptr<lt::torrent_info> ti, std::string const& save_path)
+{
+    LOG_INFO << "adding torrent " << ti->name() << ": " << ti->metadata_size()
+             << " bytes of info, save to: " << save_path;
 
     std::error_code ec_;
     if(!fs::create_directory(fs::path(save_path), ec_) && ec_.value() != 0) {
@@ -498,13 +815,7 @@ sheath::add_torrent(char const* buffer, int size, std::string const& save_path)
     }
 
     lt::add_torrent_params p;
-
-    std::vector<char> resume_data;
-    if (load_file(resume_file(ti->info_hash()), resume_data))
-    {
-        p = lt::read_resume_data(resume_data, ec);
-        PLOG_ERROR_IF(ec) << "  failed to load resume data: " << ec.message();
-    }
+    load_resume(ti->info_hash(), p);
 
     p.save_path = save_path;
     set_torrent_params(p);
@@ -516,13 +827,13 @@ sheath::add_torrent(char const* buffer, int size, std::string const& save_path)
 }
 
 void
-sheath::scan_dir(std::string const& dir_path)
+sheath::scan_dir(watch_dir const& w)
 {
     std::error_code ec;
-    auto it = fs::directory_iterator(dir_path, ec);
+    auto it = fs::directory_iterator(w.dir, ec);
     if (ec)
     {
-        LOG_ERROR << "failed to list directory: " << dir_path
+        LOG_ERROR << "failed to list directory: " << w.dir
                   << " " << ec << " " << ec.message();
         return;
     }
@@ -534,15 +845,168 @@ sheath::scan_dir(std::string const& dir_path)
             LOG_INFO << "invalid torrent file: " << file;
             continue;
         }
+        ingest_file(file.string(), w.save_path);
+    }
+}
+
+void
+sheath::ingest_file(std::string const& file, std::string const& save_path)
+{
+    {
+        std::lock_guard<std::mutex> lock(ingest_mutex_);
+        if (!ingesting_.insert(file).second) return; // already queued
+    }
+    tracked_post(parsers_, parser_stats_, [this, file, save_path]
+    {
         // there's a new file in the monitor directory, load it up
-        if (add_torrent(file.string()))
+        if (add_torrent(file, save_path))
         {
-            if (!fs::remove(file))
+            std::error_code ec;
+            if (!fs::remove(file, ec))
             {
                 LOG_ERROR << "failed to remove torrent file: " << file;
             }
         }
+        std::lock_guard<std::mutex> lock(ingest_mutex_);
+        ingesting_.erase(file);
+    });
+}
+
+std::uint64_t
+sheath::ingest_bulk(std::string body, std::string content_type, std::string save_path)
+{
+    std::shared_ptr<ingest_job> job;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        job = std::make_shared<ingest_job>(++last_job_id, std::move(body)
+            , std::move(content_type), std::move(save_path));
+        jobs_.emplace(job->id, job);
+        // keep the latest finished jobs only, running ones stay pollable
+        for (auto it = jobs_.begin(); jobs_.size() > INGEST_JOBS_KEEP && it != jobs_.end(); )
+            it = it->second->finished() ? jobs_.erase(it) : std::next(it);
+    }
+    LOG_INFO << "ingest job " << job->id << ": " << job->body.size() << " bytes";
+
+    tracked_post(parsers_, parser_stats_, [this, job]
+    {
+        auto const n = job->split();
+        LOG_INFO << "ingest job " << job->id << ": " << n << " items";
+        // parse and submit in batches, spread over the pool
+        for (std::size_t first = 0; first < n; first += INGEST_BATCH)
+        {
+            auto const last = std::min(n, first + INGEST_BATCH);
+            tracked_post(parsers_, parser_stats_, [this, job, first, last]
+            {
+                ingest_batch(job, first, last);
+            });
+        }
+    });
+    return job->id;
+}
+
+std::shared_ptr<ingest_job const>
+sheath::find_job(std::uint64_t id) const
+{
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    auto const it = jobs_.find(id);
+    if (it == jobs_.end()) return nullptr;
+    return it->second;
+}
+
+void
+sheath::ingest_batch(std::shared_ptr<ingest_job> const& job, std::size_t first, std::size_t last)
+{
+    std::vector<lt::add_torrent_params> batch;
+    batch.reserve(last - first);
+    for (auto i = first; i < last; ++i)
+    {
+        auto const& src = job->source(i);
+        if (!src.error.empty()) continue; // rejected while splitting
+
+        lt::add_torrent_params p;
+        std::string err;
+        if (!prepare_ingest(src, job->save_path, p, err))
+        {
+            job->done(i, err);
+            continue;
+        }
+        auto const ih = p.ti ? p.ti->info_hash() : p.info_hash;
+        {
+            // one add_torrent_alert completes one item, a second one would wait forever
+            std::lock_guard<std::mutex> lock(ingest_mutex_);
+            if (!pending_ingest_.try_emplace(ih, job, i).second)
+            {
+                job->done(i, "duplicate");
+                continue;
+            }
+        }
+        job->submit(i, to_hex(ih));
+        batch.push_back(std::move(p));
+    }
+
+    // the whole batch goes to the session in one burst
+    for (auto& p : batch) ses_->async_add_torrent(std::move(p));
+}
+
+// parse and validate one bulk item, like add_magnet and add_torrent do
+bool
+sheath::prepare_ingest(ingest_source const& src, std::string const& save_path,
+    lt::add_torrent_params& p, std::string& err)
+{
+    auto const bytes = src.bytes();
+    lt::error_code ec;
+    if (src.magnet)
+    {
+        p = lt::parse_magnet_uri(bytes, ec);
+        if (ec)
+        {
+            err = "invalid magnet link: " + ec.message();
+            return false;
+        }
+        if (!load_resume(p.info_hash, p) && !p.ti) p.ti = load_metadata(p.info_hash);
+    }
+    else
+    {
+        auto ti = std::make_shared<lt::torrent_info>(bytes.data(), int(bytes.size()), ec);
+        if (ec)
+        {
+            err = "invalid torrent: " + ec.message();
+            return false;
+        }
+        load_resume(ti->info_hash(), p);
+        p.ti = std::move(ti);
+        p.flags &= ~lt::torrent_flags::duplicate_is_error;
+    }
+
+    auto const& dir = src.save_path.empty() ? save_path : src.save_path;
+    if (!dir.empty())
+    {
+        std::error_code ec_;
+        if (!fs::create_directories(fs::path(dir), ec_) && ec_.value() != 0)
+        {
+            err = "failed to create directory: " + ec_.message();
+            return false;
+        }
+        p.save_path = dir;
+    }
+    set_torrent_params(p);
+    return true;
+}
+
+void
+sheath::on_ingest_added(lt::add_torrent_alert const* a)
+{
+    auto const ih = a->params.ti ? a->params.ti->info_hash() : a->params.info_hash;
+    std::pair<std::weak_ptr<ingest_job>, std::size_t> item;
+    {
+        std::lock_guard<std::mutex> lock(ingest_mutex_);
+        auto const it = pending_ingest_.find(ih);
+        if (it == pending_ingest_.end()) return;
+        item = std::move(it->second);
+        pending_ingest_.erase(it);
     }
+    if (auto job = item.first.lock())
+        job->done(item.second, a->error ? a->error.message() : "");
 }
 
 void
@@ -551,7 +1015,10 @@ sheath::doLoop()
     using namespace std::chrono;
     ses_->post_torrent_updates();
     ses_->post_session_stats();
-    ses_->post_dht_stats();
+#ifndef TORRENT_DISABLE_DHT
+    if (dht_enabled_ && dht_watched_until_ > duration_cast<seconds>(lt::clock_type::now().time_since_epoch()).count())
+        ses_->post_dht_stats();
+#endif
 
     std::this_thread::sleep_for(milliseconds(500));
 
@@ -559,18 +1026,262 @@ sheath::doLoop()
 
     lt::time_point const now = lt::clock_type::now();
 
-    if (enable_watch && next_dir_scan < now)
+    // with an event watcher running the scan only catches what it missed
+    if (enable_watch && (next_dir_scan < now || rescan_.exchange(false)))
+    {
+        for (auto const& w : watches_) scan_dir(w);
+        next_dir_scan = now + seconds(watching_ ? WATCH_FALLBACK : WATCH_INTERVAL);
+    }
+
+    if (next_checkpoint < now)
+    {
+        checkpoint();
+        next_checkpoint = now + seconds(CHECKPOINT_INTERVAL);
+        if (auto hosts = trackers_.expired(std::time(nullptr)); !hosts.empty())
+            restore_trackers(std::move(hosts));
+    }
+
+#ifndef TORRENT_DISABLE_DHT
+    // so a crash still restarts from a recent routing table
+    if (dht_enabled_ && next_dht_save < now)
+    {
+        checkpoint_session();
+        next_dht_save = now + seconds(DHT_CHECKPOINT);
+    }
+#endif
+
+    if (next_peer_sweep < now && !peers_.sweeping
+        && peers_.watched_until > duration_cast<seconds>(now.time_since_epoch()).count())
+    {
+        sweep_peers();
+        next_peer_sweep = now + seconds(PEERS_SWEEP_INTERVAL);
+    }
+
+}
+
+// spread resume saves over the ticks, so few torrents are dirty at shutdown
+void
+sheath::checkpoint()
+{
+    int n = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [h, st] : m_all_handles)
+    {
+        if (n >= CHECKPOINT_BATCH) break;
+        if (!st.need_save_resume || !st.has_metadata || !h.is_valid()) continue;
+        h.save_resume_data(lt::torrent_handle::only_if_modified);
+        ++num_outstanding_resume_data;
+        // clean until the next state update says otherwise
+        st.need_save_resume = false;
+        ++n;
+    }
+    PLOGD_IF(n > 0) << "checkpoint resume of " << n << " torrents";
+}
+
+void
+sheath::sweep_peers()
+{
+    std::vector<std::pair<lt::sha1_hash, lt::torrent_handle>> active;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const& [h, st] : m_all_handles)
+            if (st.num_peers > 0) active.emplace_back(st.info_hash, h);
+    }
+    peers_.sweeping = true;
+    tracked_post(parsers_, parser_stats_, [this, active = std::move(active)]
+    {
+        peers_.sweep(active);
+        peers_.sweeping = false;
+    });
+}
+
+void
+sheath::suppress_tracker(std::string host, lt::torrent_handle one)
+{
+    std::vector<lt::torrent_handle> handles;
+    if (one.is_valid()) handles.push_back(std::move(one));
+    else
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const& t : m_all_handles) handles.push_back(t.first);
+    }
+    tracked_post(tracker_worker_, tracker_stats_, [this, host = std::move(host), handles = std::move(handles)]
+    {
+        int n = 0;
+        for (auto const& h : handles)
+        {
+            try
+            {
+                std::vector<lt::announce_entry> keep, drop;
+                for (auto& e : h.trackers()) (tracker_host(e.url) == host ? drop : keep).push_back(std::move(e));
+                if (drop.empty()) continue;
+                // stashed first, so a resume save in between still has them
+                trackers_.stash(h.info_hash(), host, std::move(drop));
+                h.replace_trackers(keep);
+                ++n;
+            }
+            catch (std::exception const& e)
+            {
+                PLOGD << "tracker " << host << " not suppressed on a torrent: " << e.what();
+            }
+        }
+        PLOGI_IF(n > 0) << "tracker " << host << " suppressed on " << n << " torrents";
+    });
+}
+
+void
+sheath::restore_trackers(std::vector<std::string> hosts)
+{
+    tracked_post(tracker_worker_, tracker_stats_, [this, hosts = std::move(hosts)]
+    {
+        int n = 0;
+        for (auto const& [ih, entries] : trackers_.stashed(hosts))
+        {
+            try
+            {
+                auto h = ses_->find_torrent(ih);
+                if (!h.is_valid()) continue;
+                for (auto const& e : entries) h.add_tracker(e);
+                ++n;
+            }
+            catch (std::exception const& e)
+            {
+                PLOGD << "trackers not restored on " << to_hex(ih) << ": " << e.what();
+            }
+        }
+        trackers_.unstash(hosts);
+        for (auto const& host : hosts) LOG_INFO << "tracker " << host << " back on " << n << " torrents";
+    });
+}
+
+void
+sheath::write_resume(lt::add_torrent_params const& atp)
+{
+    if (is_removed(atp.info_hash)) return;
+    auto buf = lt::write_resume_data_buf(atp);
+    auto fn = resume_file(atp.info_hash);
+    ++num_pending_writes;
+    tracked_post(strand_of(atp.info_hash), writer_stats_, [this, ih = atp.info_hash, fn = std::move(fn), buf = std::move(buf)]
+    {
+        // removed while queued
+        if (is_removed(ih))
+        {
+            --num_pending_writes;
+            return;
+        }
+        // write aside and rename, a flush cut by the deadline must not tear it
+        auto const tmp = fn + ".tmp";
+        std::error_code ec;
+        if (save_file(tmp, buf)) fs::rename(tmp, fn, ec);
+        else ec = std::make_error_code(std::errc::io_error);
+        if (!ec)
+        {
+            ++num_resume_saved;
+        }
+        else
+        {
+            ++num_resume_failed;
+            LOG_ERROR << "failed to save resume file: " << fn << ' ' << ec.message();
+        }
+        --num_pending_writes;
+    });
+}
+
+void
+sheath::mark_embedded(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(resume_mutex_);
+    embedded_.insert(ih);
+}
+
+void
+sheath::mark_removed(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(resume_mutex_);
+    removed_.insert(ih);
+}
+
+bool
+sheath::is_removed(lt::sha1_hash const& ih) const
+{
+    std::lock_guard<std::mutex> lock(resume_mutex_);
+    return removed_.count(ih) > 0;
+}
+
+void
+sheath::remove_resume(lt::sha1_hash const& ih)
+{
+    tracked_post(strand_of(ih), writer_stats_, [fn = resume_file(ih)]
+    {
+        std::error_code ec;
+        fs::remove(fn + ".tmp", ec);
+        if (fs::remove(fn, ec)) LOG_INFO << "deleted resume file: " << fn;
+        else if (ec) LOG_WARNING << "failed to delete resume file: " << fn << ' ' << ec.message();
+    });
+}
+
+json::object
+sheath::getResumeStats() const
+{
+    return json::object({
+         {"pending", num_outstanding_resume_data.load()}
+        ,{"writing", num_pending_writes.load()}
+        ,{"saved", num_resume_saved.load()}
+        ,{"failed", num_resume_failed.load()}
+        ,{"flushing", flushing.load()}
+    });
+}
+
+std::shared_ptr<std::string const>
+sheath::getDhtStats()
+{
+#ifndef TORRENT_DISABLE_DHT
+    if (dht_enabled_)
     {
-        scan_dir(dir_watches.string());
-        next_dir_scan = now + seconds(WATCH_INTERVAL);
+        std::shared_ptr<std::string const> snap;
+        {
+            std::lock_guard<std::mutex> lock(dht_mutex_);
+            snap = dht_snapshot_;
+        }
+        if (auto ret = watched_snapshot(std::move(snap), dht_watched_until_, DHT_WATCH_TTL)) return ret;
+        return std::make_shared<std::string const>(R"({"enabled":true,"nodes":0,"buckets":[],"lookups":[]})");
     }
+#endif
+    return std::make_shared<std::string const>(R"({"enabled":false})");
+}
 
+std::shared_ptr<std::string const>
+sheath::getPeers()
+{
+    if (auto ret = watched_snapshot(peers_.snapshot(), peers_.watched_until, PEERS_WATCH_TTL)) return ret;
+    return std::make_shared<std::string const>(R"({"updated":0,"torrents":0,"sampled":0,"peers":0,)"
+        R"("transport":{"tcp":{"peers":0,"up":0,"down":0},"utp":{"peers":0,"up":0,"down":0}},)"
+        R"("clients":[],"prefixes":[],"topUpload":[],"topDownload":[]})");
+}
+
+json::value
+sheath::getTrackers() const
+{
+    return trackers_.to_json(svs.getSessionStats().queuedTrackerAnnounces);
+}
+
+json::value
+sheath::getPoolStats() const
+{
+    return json::value({
+         {"resumeWriters", writer_stats_.to_json()}
+        ,{"parsers", parser_stats_.to_json()}
+        ,{"trackers", tracker_stats_.to_json()}
+    });
 }
 
 void
 sheath::save_all_resume()
 {
     using namespace lt;
+    flushing = true;
+    auto const deadline = clock_type::now() + save_deadline;
+
     // get all the torrent handles that we need to save resume data for
     std::vector<torrent_status> const temp = ses_->get_torrent_status(
         [](torrent_status const& st)
@@ -584,35 +1295,57 @@ sheath::save_all_resume()
     for (auto const& st : temp)
     {
         // save_resume_data will generate an alert when it's done
-        st.handle.save_resume_data(torrent_handle::save_info_dict);
+        st.handle.save_resume_data();
         ++num_outstanding_resume_data;
         ++idx;
-        if ((idx % 32) == 0)
-        {
-            std::fprintf(stderr, "\r%d  ", num_outstanding_resume_data);
-            pop_alerts();
-        }
+        // keep draining, the writers work while we are still asking
+        if ((idx % 32) == 0) pop_alerts();
     }
 
-    LOG_INFO << "waiting for resume data: " << num_outstanding_resume_data;
+    LOG_INFO << "waiting for resume data: " << num_outstanding_resume_data
+             << " within " << duration_cast<seconds>(save_deadline).count() << "s";
 
-    while (num_outstanding_resume_data > 0)
+    auto next_report = clock_type::now() + seconds(1);
+    while (num_outstanding_resume_data > 0 || num_pending_writes > 0)
     {
-        alert const* a = ses_->wait_for_alert(seconds(S_WAIT_SAVE));
-        if (a == nullptr) continue;
-        pop_alerts();
+        auto const now = clock_type::now();
+        if (now >= deadline)
+        {
+            LOG_WARNING << "resume flush deadline reached, abandon "
+                        << num_outstanding_resume_data << " pending, "
+                        << num_pending_writes << " writing";
+            break;
+        }
+        if (now >= next_report)
+        {
+            LOG_INFO << "flushing resume: " << num_outstanding_resume_data << " pending, "
+                     << num_pending_writes << " writing, " << num_resume_saved << " saved";
+            next_report = now + seconds(1);
+        }
+        if (num_outstanding_resume_data > 0)
+        {
+            if (ses_->wait_for_alert(milliseconds(200)) != nullptr) pop_alerts();
+        }
+        else
+        {
+            std::this_thread::sleep_for(milliseconds(50));
+        }
     }
+
+    flushing = false;
+    flushed = true;
 }
 
 void
 sheath::end()
 {
-    save_all_resume();
+    // the final flush may already have run while the API was still up
+    if (!flushed) save_all_resume();
     save_session();
 }
 
 json::value
-sheath::get_torrents() const
+sheath::get_torrents(bool spark) const
 {
     // This function uses ses_->get_torrent_status() which returns a fresh snapshot,
     // so we don't need to lock m_all_handles here. However, if we were to iterate
@@ -623,11 +1356,133 @@ sheath::get_torrents() const
     json::array arr;
     for(auto const& st: torr)
     {
-        arr.emplace_back(torrent_status_to_json_obj(st));
+        auto obj = torrent_status_to_json_obj(st);
+        if (spark) obj.emplace("spark", torrent_history_.to_json(st.info_hash, TORRENT_SPARK_POINTS));
+        arr.emplace_back(std::move(obj));
     }
     return json::value(std::move(arr));
 }
 
+std::optional<std::string>
+sheath::get_files(lt::sha1_hash const& ih, file_query const& q)
+{
+    auto th = ses_->find_torrent(ih);
+    if (!th.is_valid()) return std::nullopt;
+
+    // names and sizes are rendered once, progress only for the page; byte
+    // accurate for the plain array as it always was, by whole pieces, which
+    // is cheaper, when paged
+    auto const granularity = q.paged ? lt::torrent_handle::piece_granularity : lt::file_progress_flags_t{};
+    std::vector<std::int64_t> progress;
+    bool have_progress = false;
+    auto table = files_.find(ih);
+    if (!table)
+    {
+        auto ti = th.torrent_file();
+        if (!ti) return std::string(q.paged ? R"({"total":0,"files":[]})" : "[]");
+        th.file_progress(progress, granularity);
+        have_progress = true;
+        table = std::make_shared<file_table>(std::move(ti), progress);
+        files_.store(ih, table);
+    }
+
+    file_table::dir const* d = nullptr;
+    if (q.tree && !(d = table->find_dir(q.dir))) return std::nullopt;
+    int const total = d ? int(d->files.size()) : table->size();
+    int const first = q.paged ? std::clamp(q.offset, 0, total) : 0;
+    int const last = q.paged ? first + std::min(std::clamp(q.limit, 1, FILES_PAGE_MAX), total - first) : total;
+    auto const file_at = [&](int n) { return d ? d->files[std::size_t(n)] : n; };
+
+    bool incomplete = false;
+    for (int n = first; n < last && !incomplete; ++n) incomplete = !table->complete(file_at(n));
+    if (incomplete && !have_progress) th.file_progress(progress, granularity);
+    std::vector<lt::download_priority_t> const prio = th.get_file_priorities();
+    std::unordered_map<int, lt::file_open_mode_t> open;
+    for (auto const& f : th.file_status()) open.emplace(static_cast<int>(f.file_index), f.open_mode);
+
+    std::string out;
+    out.reserve(std::size_t(last - first) * 128 + 256);
+    if (q.paged)
+    {
+        out.append(R"({"total":)").append(std::to_string(total))
+            .append(R"(,"offset":)").append(std::to_string(first));
+        if (d)
+        {
+            out.append(R"(,"dir":)").append(json::serialize(json::value(q.dir)));
+            out.append(R"(,"dirs":[)");
+            std::string path = q.dir;
+            while (!path.empty() && path.back() == '/') path.pop_back();
+            for (auto const& name : d->dirs)
+            {
+                auto const sub = table->find_dir(path.empty() ? name : path + "/" + name);
+                if (out.back() != '[') out.push_back(',');
+                out.append(R"({"name":)").append(json::serialize(json::value(name)))
+                    .append(R"(,"size":)").append(std::to_string(sub ? sub->size : 0))
+                    .append(R"(,"files":)").append(std::to_string(sub ? sub->count : 0))
+                    .push_back('}');
+            }
+            out.push_back(']');
+        }
+        out.append(R"(,"files":)");
+    }
+    out.push_back('[');
+    for (int n = first; n < last; ++n)
+    {
+        int const i = file_at(n);
+        auto const size = table->file_size(i);
+        // the flag only spares the file_progress call, live progress wins
+        bool const complete = std::size_t(i) < progress.size()
+            ? progress[std::size_t(i)] == size : table->complete(i);
+        auto const done = complete ? size : std::size_t(i) < progress.size() ? progress[std::size_t(i)] : 0;
+        if (n > first) out.push_back(',');
+        out.append(R"({"index":)").append(std::to_string(i)).push_back(',');
+        out.append(table->entry(i));
+        out.append(R"(,"progress":)").append(std::to_string(size > 0 ? done * 1000 / size : 1000));
+        out.append(R"(,"complete":)").append(complete ? "true" : "false");
+        out.append(R"(,"priority":)").append(std::to_string(
+            std::size_t(i) < prio.size() ? static_cast<int>(static_cast<std::uint8_t>(prio[std::size_t(i)])) : 0));
+        if (auto const f = open.find(i); f != open.end())
+        {
+            auto const mode = f->second & lt::file_open_mode::rw_mask;
+            if (mode == lt::file_open_mode::read_write) out.append(R"(,"state":"read/write")");
+            else if (mode == lt::file_open_mode::read_only) out.append(R"(,"state":"read")");
+            else if (mode == lt::file_open_mode::write_only) out.append(R"(,"state":"write")");
+        }
+        out.push_back('}');
+    }
+    out.push_back(']');
+    if (q.paged) out.push_back('}');
+    return out;
+}
+
+std::shared_ptr<std::string const>
+sheath::get_pieces(lt::sha1_hash const& ih)
+{
+    if (auto hit = pieces_.find(ih)) return hit;
+
+    auto th = ses_->find_torrent(ih);
+    if (!th.is_valid()) return {};
+    auto const st = th.status(lt::torrent_handle::query_pieces);
+    std::vector<int> avail;
+    th.piece_availability(avail);
+    auto const ti = th.torrent_file();
+
+    int const n = st.pieces.size();
+    std::vector<bool> have(std::size_t(n), false);
+    for (lt::piece_index_t i(0); i < lt::piece_index_t(n); ++i)
+        if (st.pieces.get_bit(i)) have[std::size_t(static_cast<int>(i))] = true;
+
+    std::string body = R"({"numPieces":)" + std::to_string(n)
+        + R"(,"pieceLength":)" + std::to_string(ti ? ti->piece_length() : 0)
+        + R"(,"numHave":)" + std::to_string(st.num_pieces)
+        + R"(,"have":)" + encode_have(have)
+        + R"(,"availability":)" + encode_counts(avail)
+        + "}";
+    auto snap = std::make_shared<std::string const>(std::move(body));
+    pieces_.store(ih, snap);
+    return snap;
+}
+
 json::value
 sheath::get_torrent(lt::sha1_hash const& ih, query_flags_t flags) const
 {
@@ -670,61 +1525,12 @@ sheath::get_torrent(lt::sha1_hash const& ih, query_flags_t flags) const
         return json::value(std::move(data));
     }
 
-    if (flags == query_files)
-    {
-        std::vector<std::int64_t> file_progress;
-        th.file_progress(file_progress);
-        std::vector<lt::open_file_state> file_status = th.file_status();
-        std::vector<lt::download_priority_t> file_prio = th.get_file_priorities();
-        auto f = file_status.begin();
-        std::shared_ptr<const lt::torrent_info> ti = th.torrent_file();
-
-        json::array data;
-
-        for (lt::file_index_t i(0); i < lt::file_index_t(ti->num_files()); ++i)
-        {
-            int const idx = static_cast<int>(i);
-            int const progress = ti->files().file_size(i) > 0
-                ? int(file_progress[idx] * 1000 / ti->files().file_size(i)) : 1000;
-            assert(file_progress[idx] <= ti->files().file_size(i));
-
-            bool const complete = file_progress[idx] == ti->files().file_size(i);
-
-            json::object obj({
-                 {"name", ti->files().file_name(i).to_string()}
-                ,{"size", ti->files().file_size(i)}
-                ,{"progress", progress}
-                ,{"complete", complete}
-                ,{"priority", static_cast<std::uint8_t>(file_prio[idx])}
-            });
-
-            if (f != file_status.end() && f->file_index == i)
-            {
-                if ((f->open_mode & lt::file_open_mode::rw_mask) == lt::file_open_mode::read_write) obj.emplace("state", "read/write");
-                else if ((f->open_mode & lt::file_open_mode::rw_mask) == lt::file_open_mode::read_only) obj.emplace("state", "read");
-                else if ((f->open_mode & lt::file_open_mode::rw_mask) == lt::file_open_mode::write_only) obj.emplace("state", "write");
-                if (f->open_mode & lt::file_open_mode::random_access) obj.emplace("state", "random_access");
-                if (f->open_mode & lt::file_open_mode::sparse) obj.emplace("state", "sparse");
-                ++f;
-            }
-            data.emplace_back(obj);
-
-        }
-        return json::value(std::move(data));
-    }
     return json::value(nullptr);
 }
 
-bool
-sheath::pause_resume_torrent(lt::sha1_hash const& ih)
+void
+sheath::pause_resume_handle(lt::torrent_handle const& th, lt::torrent_flags_t flags)
 {
-    auto th = ses_->find_torrent(ih);
-    if (!th.is_valid()) {
-        LOG_WARNING << "invalid " << ih;
-        return false;
-    }
-    LOG_INFO << "pause or resume " << ih;
-    auto const& flags = th.flags();
     if ((flags & (lt::torrent_flags::auto_managed | lt::torrent_flags::paused)) ==
         lt::torrent_flags::paused) {
         th.set_flags(lt::torrent_flags::auto_managed);
@@ -733,6 +1539,27 @@ sheath::pause_resume_torrent(lt::sha1_hash const& ih)
         th.unset_flags(lt::torrent_flags::auto_managed);
         th.pause(lt::torrent_handle::graceful_pause);
     }
+}
+
+void
+sheath::resume_handle(lt::torrent_handle const& th, lt::torrent_flags_t flags)
+{
+    th.set_flags(~(flags & lt::torrent_flags::auto_managed), lt::torrent_flags::auto_managed);
+    if ((flags & lt::torrent_flags::auto_managed) && (flags & lt::torrent_flags::paused)) {
+        th.resume();
+    }
+}
+
+bool
+sheath::pause_resume_torrent(lt::sha1_hash const& ih)
+{
+    auto th = ses_->find_torrent(ih);
+    if (!th.is_valid()) {
+        LOG_WARNING << "invalid " << to_hex(ih);
+        return false;
+    }
+    LOG_INFO << "pause or resume " << to_hex(ih);
+    pause_resume_handle(th, th.flags());
     return true;
 }
 bool
@@ -740,18 +1567,120 @@ sheath::resume_torrent(lt::sha1_hash const& ih)
 {
     auto th = ses_->find_torrent(ih);
     if (!th.is_valid()) {
-        LOG_WARNING << "invalid " << ih;
+        LOG_WARNING << "invalid " << to_hex(ih);
         return false;
     }
-    LOG_INFO << "force resume " << ih;
-    auto const& flags = th.flags();
-    th.set_flags(~(flags & lt::torrent_flags::auto_managed), lt::torrent_flags::auto_managed);
-    if ((flags & lt::torrent_flags::auto_managed) && (flags & lt::torrent_flags::paused)) {
-        th.resume();
+    LOG_INFO << "force resume " << to_hex(ih);
+    resume_handle(th, th.flags());
+    return true;
+}
+
+json::array
+sheath::batch_torrents(batch_action act, std::vector<lt::sha1_hash> const& hashes)
+{
+    // one snapshot of the session instead of a find_torrent per hash
+    std::unordered_map<lt::sha1_hash, lt::torrent_handle> handles;
+    for (auto& th : ses_->get_torrents()) handles.emplace(th.info_hash(), th);
+
+    // flags come from the cached status, toggling needs no round trip
+    std::unordered_map<lt::sha1_hash, lt::torrent_flags_t> flags;
+    if (act == batch_action::resume || act == batch_action::toggle)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto const& t : m_all_handles) flags.emplace(t.second.info_hash, t.second.flags);
+    }
+    auto const flags_of = [&flags](lt::sha1_hash const& ih, lt::torrent_handle const& th)
+    {
+        auto const it = flags.find(ih);
+        return it == flags.end() ? th.flags() : it->second;
+    };
+
+    json::array ret;
+    ret.reserve(hashes.size());
+    for (auto const& ih : hashes)
+    {
+        json::object obj({{"info_hash", to_hex(ih)}});
+        auto const it = handles.find(ih);
+        if (it == handles.end())
+        {
+            obj.emplace("ok", false);
+            obj.emplace("error", "not found");
+            ret.emplace_back(std::move(obj));
+            continue;
+        }
+        auto const& th = it->second;
+        switch (act) {
+        case batch_action::pause:
+            th.unset_flags(lt::torrent_flags::auto_managed);
+            th.pause(lt::torrent_handle::graceful_pause);
+            break;
+        case batch_action::resume: resume_handle(th, flags_of(ih, th)); break;
+        case batch_action::toggle: pause_resume_handle(th, flags_of(ih, th)); break;
+        case batch_action::recheck:
+            // complete files may turn out not to be
+            files_.remove(ih);
+            th.force_recheck();
+            break;
+        case batch_action::remove:
+        case batch_action::remove_data:
+            // the resume file goes with the torrent_removed_alert
+            mark_removed(ih);
+            ses_->remove_torrent(th, act == batch_action::remove_data
+                ? lt::session::delete_files : lt::remove_flags_t{});
+            handles.erase(it);
+            break;
+        }
+        obj.emplace("ok", true);
+        ret.emplace_back(std::move(obj));
     }
+    LOG_INFO << "batch " << static_cast<int>(act) << " on " << hashes.size() << " torrents";
+    return ret;
+}
+
+bool
+sheath::plan_content(lt::sha1_hash const& ih, int file_index, content_plan& plan) const
+{
+    auto th = ses_->find_torrent(ih);
+    if (!th.is_valid()) return false;
+    auto const ti = th.torrent_file();
+    if (!ti) return false; // no metadata yet
+
+    auto const& files = ti->files();
+    if (file_index < 0 || file_index >= files.num_files()) return false;
+    lt::file_index_t const fi(file_index);
+    if (files.pad_file_at(fi)) return false;
+
+    // the one round trip of a stream, later pieces come from the alerts
+    auto const st = th.status(lt::torrent_handle::query_save_path | lt::torrent_handle::query_pieces);
+    plan.th = th;
+    plan.pieces = &streamed_;
+    plan.have = st.pieces;
+    plan.seeding = st.is_seeding;
+    plan.path = files.file_path(fi, st.save_path);
+    plan.file_offset = files.file_offset(fi);
+    plan.file_size = files.file_size(fi);
+    plan.piece_length = ti->piece_length();
+    plan.num_pieces = ti->num_pieces();
     return true;
 }
 
+std::vector<lt::sha1_hash>
+sheath::filter_torrents(torrent_filter const& f) const
+{
+    std::vector<lt::sha1_hash> ret;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& [h, st] : m_all_handles)
+    {
+        if (f.state && static_cast<int>(st.state) != *f.state) continue;
+        if (f.paused && bool(st.flags & lt::torrent_flags::paused) != *f.paused) continue;
+        if (f.finished && st.is_finished != *f.finished) continue;
+        if (!f.save_path.empty() && !st.save_path.starts_with(f.save_path)) continue;
+        if (!f.name.empty() && st.name.find(f.name) == std::string::npos) continue;
+        ret.push_back(st.info_hash);
+    }
+    return ret;
+}
+
 bool
 sheath::exists(lt::sha1_hash const& ih)
 {
@@ -763,13 +1692,9 @@ sheath::exists(lt::sha1_hash const& ih)
 bool
 sheath::drop_torrent(lt::sha1_hash const& ih, bool const with_data)
 {
-    // also delete the resume file
-    std::string const rpath = resume_file(ih);
-    if (std::remove(rpath.c_str()) < 0)
-        LOG_WARNING << "failed to delete resume file: " << rpath;
-    else
-        LOG_INFO << "deleted resume file: " << rpath;
-
+    // saves still in flight are dropped, the resume file is deleted
+    // with the torrent_removed_alert, after the writes queued before it
+    mark_removed(ih);
     auto th = ses_->find_torrent(ih);
     if (th.is_valid())
     {
@@ -781,6 +1706,8 @@ sheath::drop_torrent(lt::sha1_hash const& ih, bool const with_data)
         ses_->remove_torrent(th, flag);
         return true;
     }
+    // not in the session, a stale resume file would bring it back
+    remove_resume(ih);
     return false;
 }
 
@@ -790,7 +1717,7 @@ sheath::on_torrent_finished(lt::torrent_handle const& th)
     if (dir_moved.empty()) return;
     const auto st = th.status(lt::torrent_handle::query_save_path);
     const auto td = st.total_payload_download;
-    LOG_DEBUG << "finish " << st.info_hash << " ppm " << st.progress_ppm
+    LOG_DEBUG << "finish " << to_hex(st.info_hash) << " ppm " << st.progress_ppm
               << " " << st.is_finished << " download " << td << " bytes";
     if (st.progress_ppm < PERCENT_DONE || 0 == td) {
         LOG_DEBUG << " unfinished or not downloaded, do not move";
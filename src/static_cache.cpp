@@ -0,0 +1,159 @@
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <vector>
+
+#include <zlib.h>
+
+#include "compress.hpp"
+#include "http_util.hpp"
+#include "log.hpp"
+#include "static_cache.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+namespace {
+
+std::string
+http_date(fs::file_time_type t)
+{
+    auto const sys = std::chrono::file_clock::to_sys(t);
+    std::time_t const tt = std::chrono::system_clock::to_time_t(
+        std::chrono::time_point_cast<std::chrono::system_clock::duration>(sys));
+    std::tm tm{};
+    gmtime_r(&tt, &tm);
+    char buf[32];
+    auto const n = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+} // namespace
+
+static_cache::
+static_cache(std::string root)
+    : root_(std::move(root))
+{
+    refresh(true);
+}
+
+std::shared_ptr<static_asset const>
+static_cache::
+load_file(fs::path const& file, std::string_view key) const
+{
+    std::error_code ec;
+    auto const size = fs::file_size(file, ec);
+    if (ec || size > STATIC_MAX_FILE) return nullptr;
+
+    std::ifstream f(file, std::ios_base::in | std::ios_base::binary);
+    std::string raw(size, '\0');
+    if (size > 0 && !f.read(raw.data(), std::streamsize(size))) return nullptr;
+
+    auto asset = std::make_shared<static_asset>();
+    asset->mtime = fs::last_write_time(file, ec);
+    asset->last_modified = http_date(asset->mtime);
+    asset->mime = mime_type(key);
+
+    auto const crc = crc32(0L, reinterpret_cast<Bytef const*>(raw.data()), uInt(raw.size()));
+    char tag[40];
+    std::snprintf(tag, sizeof(tag), "\"%zx-%08lx\"", raw.size(), static_cast<unsigned long>(crc));
+    asset->etag = tag;
+
+    if (compressible(asset->mime) && raw.size() > STATIC_GZIP_MIN)
+    {
+        std::string gz;
+        // keep the variant only when it saves at least a tenth
+        if (compress(raw, gz, coding::gzip, 9) && gz.size() < raw.size() - raw.size() / 10)
+            asset->gzip = std::make_shared<std::string const>(std::move(gz));
+    }
+    asset->raw = std::make_shared<std::string const>(std::move(raw));
+    return asset;
+}
+
+void
+static_cache::
+refresh(bool force)
+{
+    auto const now = std::chrono::steady_clock::now();
+    if (!force && now < next_refresh_) return;
+    next_refresh_ = now + std::chrono::seconds(STATIC_REFRESH);
+
+    std::unordered_map<std::string, std::shared_ptr<static_asset const>> fresh;
+    std::error_code ec;
+    fs::path const root(root_);
+    auto it = fs::recursive_directory_iterator(root, ec);
+    if (ec)
+    {
+        if (!missing_) LOG_WARNING << "failed to list web UI: " << root_ << ' ' << ec.message();
+        else PLOGD << "failed to list web UI: " << root_ << ' ' << ec.message();
+        missing_ = true;
+        return;
+    }
+
+    int loaded = 0;
+    for (auto const& e : it)
+    {
+        if (!e.is_regular_file(ec)) continue;
+        auto const key = "/" + e.path().lexically_relative(root).generic_string();
+        auto const mtime = e.last_write_time(ec);
+        auto const size = e.file_size(ec);
+
+        std::shared_ptr<static_asset const> prev;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex_);
+            auto const p = assets_.find(key);
+            if (p != assets_.end()) prev = p->second;
+        }
+        if (prev && prev->mtime == mtime && prev->raw->size() == size)
+        {
+            fresh.emplace(key, std::move(prev));
+            continue;
+        }
+        if (auto asset = load_file(e.path(), key))
+        {
+            fresh.emplace(key, std::move(asset));
+            ++loaded;
+        }
+    }
+
+    // warned once when it empties, told when it is back
+    if (fresh.empty() && !missing_) LOG_WARNING << "no web UI files in " << root_;
+    else if (!fresh.empty() && missing_) LOG_INFO << "web UI found in " << root_;
+    missing_ = fresh.empty();
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    bool const changed = loaded > 0 || fresh.size() != assets_.size();
+    assets_.swap(fresh);
+    PLOGI_IF(changed) << "web UI cache: " << assets_.size() << " files, " << loaded << " loaded";
+}
+
+std::shared_ptr<static_asset const>
+static_cache::
+find(std::string_view path)
+{
+    std::string key(path);
+    if (key.empty() || key.back() == '/') key.append("index.html");
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto const it = assets_.find(key);
+        if (it != assets_.end()) return it->second;
+    }
+
+    // created since the last refresh, read it once now
+    auto asset = load_file(path_cat(root_, key), key);
+    if (!asset) return nullptr;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    assets_.insert_or_assign(key, asset);
+    return asset;
+}
+
+std::size_t
+static_cache::
+size() const
+{
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return assets_.size();
+}
+
+} // namespace btd
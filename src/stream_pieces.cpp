@@ -0,0 +1,105 @@
+
+#include <algorithm>
+
+#include "stream_pieces.hpp"
+
+namespace btd {
+
+void
+stream_pieces::
+open(lt::sha1_hash const& ih, lt::typed_bitfield const& have, int num_pieces, bool seeding)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& t = torrents_[ih];
+    ++t.streams;
+    t.since.resize(std::size_t(num_pieces), missing);
+    for (int p = 0; p < num_pieces; ++p)
+    {
+        // finished before this stream, or their alert is still queued
+        if (t.since[p] == missing && (seeding || (p < have.size() && have[lt::piece_index_t(p)])))
+            t.since[p] = on_disk;
+    }
+}
+
+void
+stream_pieces::
+close(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = torrents_.find(ih);
+    if (it != torrents_.end() && --it->second.streams <= 0) torrents_.erase(it);
+}
+
+void
+stream_pieces::
+finished(lt::sha1_hash const& ih, int piece)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = torrents_.find(ih);
+    if (it == torrents_.end()) return;
+    auto& t = it->second;
+    if (piece < 0 || piece >= int(t.since.size())) return;
+    t.since[piece] = write_cache ? t.asked : on_disk;
+}
+
+void
+stream_pieces::
+flushed(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = torrents_.find(ih);
+    if (it != torrents_.end() && it->second.done < it->second.asked) ++it->second.done;
+}
+
+void
+stream_pieces::
+remove(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    torrents_.erase(ih);
+}
+
+int
+stream_pieces::
+ready(lt::sha1_hash const& ih, int first, int end, wait& why, bool& flush)
+{
+    flush = false;
+    why = wait::piece;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = torrents_.find(ih);
+    if (it == torrents_.end()) return first;
+    auto& t = it->second;
+    end = std::min(end, int(t.since.size()));
+    for (int p = first; p < end; ++p)
+    {
+        auto& s = t.since[p];
+        if (s == missing) return p;
+        if (s == on_disk) continue;
+        // a flush asked after the piece finished is done
+        if (t.done > s)
+        {
+            s = on_disk;
+            continue;
+        }
+        why = wait::flush;
+        if (t.asked <= s)
+        {
+            ++t.asked;
+            flush = true;
+        }
+        return p;
+    }
+    why = wait::none;
+    return end;
+}
+
+void
+stream_pieces::
+expire_flush(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = torrents_.find(ih);
+    if (it != torrents_.end()) it->second.done = it->second.asked;
+}
+
+} // namespace btd
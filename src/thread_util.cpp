@@ -0,0 +1,142 @@
+
+#include <algorithm>
+#include <charconv>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#include "log.hpp"
+#include "thread_util.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+bool
+parse_cpu_list(std::string_view s, std::vector<int>& cpus)
+{
+    cpus.clear();
+    auto const number = [](std::string_view v, int& n)
+    {
+        auto const [ptr, ec] = std::from_chars(v.data(), v.data() + v.size(), n);
+        return ec == std::errc() && ptr == v.data() + v.size() && n >= 0;
+    };
+    while (!s.empty())
+    {
+        auto const comma = s.find(',');
+        auto const item = s.substr(0, comma);
+        s = comma == std::string_view::npos ? std::string_view{} : s.substr(comma + 1);
+        if (item.empty()) continue;
+
+        auto const dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if (!number(item.substr(0, dash), first)) return false;
+        if (dash == std::string_view::npos) last = first;
+        else if (!number(item.substr(dash + 1), last) || last < first) return false;
+        for (int i = first; i <= last; ++i) cpus.push_back(i);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+bool
+pin_thread(std::vector<int> const& cpus)
+{
+    if (cpus.empty()) return true;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int const c : cpus)
+    {
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+    }
+    int const rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0)
+    {
+        LOG_WARNING << "failed to pin thread: " << std::system_category().message(rc);
+        return false;
+    }
+    return true;
+#else
+    LOG_WARNING << "cpu pinning is not supported on this platform";
+    return false;
+#endif
+}
+
+scoped_affinity::
+scoped_affinity(std::vector<int> const& cpus)
+{
+    if (cpus.empty()) return;
+#ifdef __linux__
+    if (pthread_getaffinity_np(pthread_self(), sizeof(prev_), &prev_) != 0) return;
+    set_ = pin_thread(cpus);
+#endif
+}
+
+scoped_affinity::
+~scoped_affinity()
+{
+#ifdef __linux__
+    if (set_) pthread_setaffinity_np(pthread_self(), sizeof(prev_), &prev_);
+#endif
+}
+
+json::array
+cpus_json(std::vector<int> const& cpus)
+{
+    json::array arr;
+    for (int const c : cpus) arr.emplace_back(c);
+    return arr;
+}
+
+json::value
+pool_stats::
+to_json() const
+{
+    auto const up = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    auto const busy = busy_us.load();
+    return json::value({
+         {"threads", threads}
+        ,{"queued", queued.load()}
+        ,{"running", running.load()}
+        ,{"tasks", tasks.load()}
+        ,{"busyUs", busy}
+        ,{"utilisation", up > 0 && threads > 0 ? double(busy) / (double(up) * threads) : 0.0}
+    });
+}
+
+json::value
+loop_stats::
+to_json() const
+{
+    return json::value({
+         {"threads", threads}
+        ,{"lagUs", lag_us.load()}
+        ,{"maxLagUs", max_lag_us.load()}
+        ,{"probes", probes.load()}
+    });
+}
+
+void
+loop_probe::
+arm()
+{
+    auto const due = std::chrono::steady_clock::now() + std::chrono::milliseconds(LOOP_PROBE_MS);
+    timer_.expires_at(due);
+    timer_.async_wait([self = shared_from_this(), due](beast::error_code ec)
+    {
+        if (ec) return;
+        auto const lag = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - due).count();
+        self->stats_.lag_us = lag;
+        auto prev = self->stats_.max_lag_us.load();
+        while (lag > prev && !self->stats_.max_lag_us.compare_exchange_weak(prev, lag)) {}
+        ++self->stats_.probes;
+        self->arm();
+    });
+}
+
+} // namespace btd
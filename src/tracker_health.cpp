@@ -0,0 +1,295 @@
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <unordered_set>
+
+#include "tracker_health.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+namespace {
+
+std::string
+pending_key(lt::sha1_hash const& ih, std::string const& url)
+{
+    return ih.to_string() + url;
+}
+
+} // namespace
+
+std::string
+tracker_host(std::string_view url)
+{
+    if (auto const scheme = url.find("://"); scheme != std::string_view::npos) url.remove_prefix(scheme + 3);
+    url = url.substr(0, url.find_first_of("/?"));
+    if (auto const at = url.rfind('@'); at != std::string_view::npos) url.remove_prefix(at + 1);
+    if (url.starts_with('[')) url = url.substr(1, url.find(']') - 1);
+    else url = url.substr(0, url.find(':'));
+    std::string ret(url);
+    std::transform(ret.begin(), ret.end(), ret.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return ret;
+}
+
+tracker_health::url_stats*
+tracker_health::
+find(std::string const& url)
+{
+    auto it = urls_.find(url);
+    if (it != urls_.end()) return &it->second;
+    if (urls_.size() >= TRACKERS_MAX)
+    {
+        ++dropped_;
+        return nullptr;
+    }
+    it = urls_.emplace(url, url_stats{}).first;
+    it->second.host = tracker_host(url);
+    return &it->second;
+}
+
+void
+tracker_health::
+announced(lt::sha1_hash const& ih, std::string const& url, lt::time_point t)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto* s = find(url)) ++s->announces;
+    if (pending_.size() >= TRACKER_PENDING_MAX)
+    {
+        // those never answered, nor failed, are not worth a latency
+        auto const old = t - lt::seconds(TRACKER_PENDING_TTL);
+        for (auto it = pending_.begin(); it != pending_.end(); )
+            it = it->second < old ? pending_.erase(it) : std::next(it);
+        if (pending_.size() >= TRACKER_PENDING_MAX) return;
+    }
+    pending_[pending_key(ih, url)] = t;
+}
+
+void
+tracker_health::
+replied(lt::sha1_hash const& ih, std::string const& url, int peers, lt::time_point t)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto* s = find(url);
+    if (!s) return;
+    ++s->replies;
+    s->fails_in_row = 0;
+    s->peers = peers;
+    s->last_reply = std::time(nullptr);
+    if (auto it = pending_.find(pending_key(ih, url)); it != pending_.end())
+    {
+        s->latency_ms += std::chrono::duration_cast<std::chrono::milliseconds>(t - it->second).count();
+        pending_.erase(it);
+    }
+    // one answer is enough to trust the host again
+    auto& h = hosts_[s->host];
+    h.fails_in_row = 0;
+    h.backoff = 0;
+}
+
+tracker_health::verdict
+tracker_health::
+failed(lt::sha1_hash const& ih, std::string const& url, bool reachable, std::string message)
+{
+    auto const now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(pending_key(ih, url));
+    auto* s = find(url);
+    if (!s) return verdict::ok;
+    ++s->errors;
+    ++s->fails_in_row;
+    s->last_error = now;
+    s->message = std::move(message);
+    if (reachable) return verdict::ok;
+
+    auto& h = hosts_[s->host];
+    if (h.suppressed_until > now) return suppress ? verdict::suppressed : verdict::ok;
+    if (h.fails_in_row++ == 0) h.fail_since = now;
+    if (!suppress || h.fails_in_row < TRACKER_FAIL_LIMIT || now - h.fail_since < TRACKER_FAIL_WINDOW)
+        return verdict::ok;
+
+    h.backoff = h.backoff ? std::min(h.backoff * 2, TRACKER_BACKOFF_MAX) : TRACKER_BACKOFF_MIN;
+    h.suppressed_until = now + h.backoff;
+    h.fails_in_row = 0;
+    ++h.suppressions;
+    ++suppressions_;
+    return verdict::dead;
+}
+
+void
+tracker_health::
+scraped(std::string const& url, int complete, int incomplete)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto* s = find(url);
+    if (!s) return;
+    ++s->scrapes;
+    s->complete = complete;
+    s->incomplete = incomplete;
+}
+
+void
+tracker_health::
+scrape_failed(std::string const& url, std::string message)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto* s = find(url);
+    if (!s) return;
+    ++s->scrape_errors;
+    s->message = std::move(message);
+}
+
+void
+tracker_health::
+stash(lt::sha1_hash const& ih, std::string const& host, std::vector<lt::announce_entry> entries)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& v = stash_[ih];
+    for (auto& e : entries) v.emplace_back(host, std::move(e));
+}
+
+std::vector<std::string>
+tracker_health::
+expired(std::time_t now)
+{
+    std::vector<std::string> ret;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [host, h] : hosts_)
+    {
+        if (h.suppressed_until == 0 || h.suppressed_until > now) continue;
+        // on probation, the backoff doubles if it fails again
+        h.suppressed_until = 0;
+        h.fails_in_row = 0;
+        ret.push_back(host);
+    }
+    return ret;
+}
+
+std::vector<std::pair<lt::sha1_hash, std::vector<lt::announce_entry>>>
+tracker_health::
+stashed(std::vector<std::string> const& hosts) const
+{
+    std::unordered_set<std::string_view> const want(hosts.begin(), hosts.end());
+    std::vector<std::pair<lt::sha1_hash, std::vector<lt::announce_entry>>> ret;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto const& [ih, v] : stash_)
+    {
+        std::vector<lt::announce_entry> entries;
+        for (auto const& [host, e] : v)
+            if (want.count(host)) entries.push_back(e);
+        if (!entries.empty()) ret.emplace_back(ih, std::move(entries));
+    }
+    return ret;
+}
+
+void
+tracker_health::
+unstash(std::vector<std::string> const& hosts)
+{
+    std::unordered_set<std::string_view> const gone(hosts.begin(), hosts.end());
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = stash_.begin(); it != stash_.end(); )
+    {
+        auto& v = it->second;
+        v.erase(std::remove_if(v.begin(), v.end(), [&](auto const& p) { return gone.count(p.first) > 0; }), v.end());
+        it = v.empty() ? stash_.erase(it) : std::next(it);
+    }
+}
+
+void
+tracker_health::
+restore_into(lt::add_torrent_params& atp) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto const it = stash_.find(atp.info_hash);
+    if (it == stash_.end()) return;
+    atp.tracker_tiers.resize(atp.trackers.size(), 0);
+    for (auto const& [host, e] : it->second)
+    {
+        // given back already while this resume data was taken
+        if (std::find(atp.trackers.begin(), atp.trackers.end(), e.url) != atp.trackers.end()) continue;
+        atp.trackers.push_back(e.url);
+        atp.tracker_tiers.push_back(e.tier);
+    }
+}
+
+void
+tracker_health::
+remove(lt::sha1_hash const& ih)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stash_.erase(ih);
+}
+
+int
+tracker_health::
+num_suppressed() const
+{
+    auto const now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return int(std::count_if(hosts_.begin(), hosts_.end(), [now](auto const& p) { return p.second.suppressed_until > now; }));
+}
+
+json::value
+tracker_health::
+to_json(int queued_announces) const
+{
+    auto const now = std::time(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string_view, int> stashed;
+    for (auto const& [ih, v] : stash_)
+    {
+        std::unordered_set<std::string_view> seen;
+        for (auto const& [host, e] : v)
+            if (seen.insert(host).second) ++stashed[host];
+    }
+
+    json::array trackers;
+    trackers.reserve(urls_.size());
+    for (auto const& [url, s] : urls_)
+    {
+        json::object obj({
+             {"url", url}
+            ,{"host", s.host}
+            ,{"announces", s.announces}
+            ,{"replies", s.replies}
+            ,{"errors", s.errors}
+            ,{"failsInRow", s.fails_in_row}
+            ,{"latencyMs", s.replies ? s.latency_ms / s.replies : 0}
+            ,{"peers", s.peers}
+            ,{"lastReply", s.last_reply}
+            ,{"lastError", s.last_error}
+            ,{"message", s.message}
+            ,{"scrapes", s.scrapes}
+            ,{"scrapeErrors", s.scrape_errors}
+        });
+        if (s.complete >= 0) obj.emplace("seeds", s.complete);
+        if (s.incomplete >= 0) obj.emplace("leeches", s.incomplete);
+        trackers.emplace_back(std::move(obj));
+    }
+
+    json::array hosts;
+    for (auto const& [host, h] : hosts_)
+    {
+        auto const it = stashed.find(host);
+        hosts.emplace_back(json::object({
+             {"host", host}
+            ,{"failsInRow", h.fails_in_row}
+            ,{"suppressed", h.suppressed_until > now}
+            ,{"suppressedUntil", h.suppressed_until}
+            ,{"backoff", h.backoff}
+            ,{"suppressions", h.suppressions}
+            ,{"torrents", it == stashed.end() ? 0 : it->second}
+        }));
+    }
+
+    return json::value({
+         {"queuedAnnounces", queued_announces}
+        ,{"suppress", suppress.load()}
+        ,{"dropped", dropped_}
+        ,{"trackers", std::move(trackers)}
+        ,{"hosts", std::move(hosts)}
+    });
+}
+
+} // namespace btd
@@ -0,0 +1,72 @@
+
+#include <algorithm>
+
+#include "upload_pool.hpp"
+#include "util.hpp"
+
+namespace btd {
+
+std::string
+upload_pool::
+acquire(std::size_t size)
+{
+    std::string buf;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the biggest one, it needs to grow the least
+        auto best = free_.end();
+        for (auto it = free_.begin(); it != free_.end(); ++it)
+        {
+            if (best == free_.end() || it->capacity() > best->capacity()) best = it;
+        }
+        if (best != free_.end())
+        {
+            buf = std::move(*best);
+            free_.erase(best);
+            ++reused;
+        }
+    }
+    buf.clear();
+    buf.reserve(std::min(size, UPLOAD_RESERVE_MAX));
+    return buf;
+}
+
+void
+upload_pool::
+release(std::string&& buf, std::size_t received)
+{
+    ++uploads;
+    bytes += std::int64_t(received);
+    auto prev = max_bytes.load();
+    while (std::int64_t(received) > prev && !max_bytes.compare_exchange_weak(prev, std::int64_t(received))) {}
+
+    if (buf.capacity() == 0 || buf.capacity() > UPLOAD_POOL_MAX_BUF) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < UPLOAD_POOL_KEEP) free_.push_back(std::move(buf));
+}
+
+json::value
+upload_pool::
+to_json()
+{
+    std::size_t pooled = 0;
+    std::size_t pooled_bytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pooled = free_.size();
+        for (auto const& b : free_) pooled_bytes += b.capacity();
+    }
+    return json::value({
+         {"uploads", uploads.load()}
+        ,{"bytes", bytes.load()}
+        ,{"maxBytes", max_bytes.load()}
+        ,{"rejected", rejected.load()}
+        ,{"parsed", parsed.load()}
+        ,{"parseUs", parse_us.load()}
+        ,{"reused", reused.load()}
+        ,{"pooled", pooled}
+        ,{"pooledBytes", pooled_bytes}
+    });
+}
+
+} // namespace btd
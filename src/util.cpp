@@ -6,7 +6,6 @@
 #include <fstream>
 #include <iomanip>
 #include <mutex>
-#include <sstream>
 #include <string.h> // strdup
 #include <thread>
 #include <utility>
@@ -21,6 +20,7 @@
 #include <libtorrent/string_view.hpp>
 #include <libtorrent/time.hpp>
 
+#include "hash_codec.hpp"
 #include "log.hpp"
 #include "util.hpp"
 
@@ -62,13 +62,9 @@ timestamp()
 bool
 is_resume_file(std::string const &s)
 {
-    static std::string const hex_digit = "0123456789abcdef";
     if (s.size() != 40 + 7) return false;
-    if (s.substr(40) != ".resume") return false;
-    for (char const c : s.substr(0, 40)) {
-        if (hex_digit.find(c) == std::string::npos) return false;
-    }
-    return true;
+    if (s.compare(40, 7, ".resume") != 0) return false;
+    return is_hex(std::string_view(s).substr(0, 40));
 }
 
 bool
@@ -102,21 +98,24 @@ path_cat(std::string_view const &base, std::string_view const &path)
 }
 
 bool
-from_hex(lt::sha1_hash &ih, std::string const &s)
+from_hex(lt::sha1_hash &ih, std::string_view s)
 {
-    if (s.size() != 40) { return false; }
-    std::stringstream hash(s.c_str());
-    hash >> ih;
-    if (hash.fail()) { return false; }
-    return true;
+    return decode_hex(s, {ih.data(), ih.size()});
+}
+
+bool
+parse_info_hash(lt::sha1_hash &ih, std::string_view s)
+{
+    if (s.size() == hex_size(ih.size())) return decode_hex(s, {ih.data(), ih.size()});
+    return decode_base32(s, {ih.data(), ih.size()});
 }
 
 std::string
 to_hex(lt::sha1_hash const &ih)
 {
-    std::stringstream ret;
-    ret << ih;
-    return ret.str();
+    std::string ret(hex_size(ih.size()), '\0');
+    encode_hex({ih.data(), ih.size()}, ret.data());
+    return ret;
 }
 
 bool
@@ -125,6 +124,7 @@ prepare_dirs(std::string const & cd)
     fs::path cd_(cd);
     std::vector<fs::path> paths = {cd_
         , cd_ / RESUME_DIR
+        , cd_ / META_DIR
         , cd_ / WATCH_DIR
         , cd_ / CERT_DIR
     };